@@ -0,0 +1,382 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "banker.h"
+#include "shared.h"
+
+typedef bool (*safety_kernel_fn)(const struct banker_state* state, int16_t* work);
+
+static bool safety_scalar(const struct banker_state* state, int16_t* work);
+static bool safety_avx2(const struct banker_state* state, int16_t* work);
+
+static safety_kernel_fn safety_kernel = NULL;
+static int kernel_kind = KERNEL_AUTO;
+
+// Private function to round size up to a multiple of align
+static size_t round_up(size_t size, size_t align) {
+	return (size + align - 1) / align * align;
+}
+
+// Public function to get the bytes needed for a banker state of num_procs x num_res
+size_t banker_size(int num_procs, int num_res) {
+	size_t stride = round_up(num_res, BANKER_LANES);
+	size_t size = round_up(sizeof(struct banker_state), 32);
+	size += 2 * round_up(stride * sizeof(int16_t), 32);
+	size += 2 * num_procs * stride * sizeof(int16_t);
+	size += round_up(num_procs, 64) / 64 * sizeof(uint64_t);
+	return size;
+}
+
+// Public function to lay out and zero a banker state in banker_size() bytes at state
+void banker_layout(struct banker_state* state, int num_procs, int num_res) {
+	memset(state, 0, banker_size(num_procs, num_res));
+	state->num_procs = num_procs;
+	state->num_res = num_res;
+	state->stride = round_up(num_res, BANKER_LANES);
+	state->mask_words = round_up(num_procs, 64) / 64;
+
+	// Every row starts on a 32 byte boundary for aligned vector loads
+	size_t offset = round_up(sizeof(struct banker_state), 32);
+	state->available_off = offset;
+	offset += round_up(state->stride * sizeof(int16_t), 32);
+	state->shared_off = offset;
+	offset += round_up(state->stride * sizeof(int16_t), 32);
+	state->need_off = offset;
+	offset += (size_t)num_procs * state->stride * sizeof(int16_t);
+	state->alloc_off = offset;
+	offset += (size_t)num_procs * state->stride * sizeof(int16_t);
+	state->active_off = offset;
+}
+
+// Public function to pick the safety kernel. KERNEL_AUTO uses AVX2 if the CPU has it.
+// Returns false if the requested kernel is not supported on this CPU. Call it before any
+// thread runs a check, as the kernel is read without a lock.
+bool banker_set_kernel(int kernel) {
+	__builtin_cpu_init();
+	bool has_avx2 = __builtin_cpu_supports("avx2");
+	if (kernel == KERNEL_AUTO) kernel = has_avx2 ? KERNEL_AVX2 : KERNEL_SCALAR;
+	if (kernel == KERNEL_AVX2 && !has_avx2) return false;
+
+	kernel_kind = kernel;
+	safety_kernel = (kernel == KERNEL_AVX2) ? safety_avx2 : safety_scalar;
+	return true;
+}
+
+// Public function to get the name of the safety kernel in use
+const char* banker_kernel_name() {
+	return kernel_kind == KERNEL_AVX2 ? "avx2" : "scalar";
+}
+
+// Scalar safety sequence: finish any pending process whose need row fits in work
+static bool safety_scalar(const struct banker_state* state, int16_t* work) {
+	const int stride = state->stride;
+	uint64_t pending[state->mask_words];
+	memcpy(pending, banker_active(state), sizeof(pending));
+
+	bool progress = true;
+	while (progress) {
+		progress = false;
+		bool any_pending = false;
+		for (int w = 0; w < state->mask_words; w++) {
+			uint64_t bits = pending[w];
+			while (bits) {
+				int i = w * 64 + __builtin_ctzll(bits);
+				bits &= bits - 1;
+
+				const int16_t* need = banker_need(state, i);
+				bool fits = true;
+				for (int j = 0; j < stride; j++) {
+					if (need[j] > work[j]) {
+						fits = false;
+						break;
+					}
+				}
+				if (!fits) continue;
+
+				const int16_t* alloc = banker_alloc(state, i);
+				for (int j = 0; j < stride; j++) {
+					work[j] += alloc[j];
+				}
+				pending[w] &= ~(1ULL << (i - w * 64));
+				progress = true;
+			}
+			if (pending[w]) any_pending = true;
+		}
+		if (!any_pending) return true;
+	}
+	return false;
+}
+
+// AVX2 safety sequence: compares a whole 16 x int16 slice of a need row per instruction
+__attribute__((target("avx2")))
+static bool safety_avx2(const struct banker_state* state, int16_t* work) {
+	const int vecs = state->stride / BANKER_LANES;
+	uint64_t pending[state->mask_words];
+	__m256i work_v[vecs];
+	memcpy(pending, banker_active(state), sizeof(pending));
+	for (int v = 0; v < vecs; v++) {
+		work_v[v] = _mm256_loadu_si256((const __m256i*)&work[v * BANKER_LANES]);
+	}
+
+	bool safe = false;
+	bool progress = true;
+	while (progress) {
+		progress = false;
+		bool any_pending = false;
+		for (int w = 0; w < state->mask_words; w++) {
+			uint64_t bits = pending[w];
+			while (bits) {
+				int i = w * 64 + __builtin_ctzll(bits);
+				bits &= bits - 1;
+
+				const __m256i* need = (const __m256i*)banker_need(state, i);
+				__m256i over = _mm256_setzero_si256();
+				for (int v = 0; v < vecs; v++) {
+					over = _mm256_or_si256(over, _mm256_cmpgt_epi16(_mm256_load_si256(&need[v]), work_v[v]));
+				}
+				if (!_mm256_testz_si256(over, over)) continue;
+
+				const __m256i* alloc = (const __m256i*)banker_alloc(state, i);
+				for (int v = 0; v < vecs; v++) {
+					work_v[v] = _mm256_add_epi16(work_v[v], _mm256_load_si256(&alloc[v]));
+				}
+				pending[w] &= ~(1ULL << (i - w * 64));
+				progress = true;
+			}
+			if (pending[w]) any_pending = true;
+		}
+		if (!any_pending) {
+			safe = true;
+			break;
+		}
+	}
+
+	for (int v = 0; v < vecs; v++) {
+		_mm256_storeu_si256((__m256i*)&work[v * BANKER_LANES], work_v[v]);
+	}
+	return safe;
+}
+
+// Public function to run the safety sequence over every active process starting from work.
+// work holds state->stride entries and is updated to what is available once the
+// finished processes give back their allocation.
+bool banker_safe_sequence(const struct banker_state* state, int16_t* work) {
+	return safety_kernel(state, work);
+}
+
+// Private function to check requests stay within what sim_pid may still claim, judged from
+// the process table so shared resources are covered too. Fills exclusive with requests
+// minus the shared resources, which is the part the accounting sees.
+static bool within_claim(struct oss_shm* shm, const struct banker_state* state, int sim_pid, const int* requests, int* exclusive) {
+	const int16_t* shared = banker_shared(state);
+	const int16_t* max_res = pcb_max_res(shm, sim_pid);
+	const int16_t* allow_res = pcb_allow_res(shm, sim_pid);
+	for (int j = 0; j < state->num_res; j++) {
+		if (requests[j] < 0 || requests[j] > max_res[j] - allow_res[j]) return false;
+		exclusive[j] = shared[j] ? 0 : requests[j];
+	}
+	return true;
+}
+
+// Public function to reset the banker state to all resources available and no processes.
+// Also picks the safety kernel if none has been, while the caller is still single threaded.
+void banker_init(struct oss_shm* shm) {
+	if (safety_kernel == NULL) banker_set_kernel(KERNEL_AUTO);
+	struct banker_state* state = shm_banker(shm);
+	banker_layout(state, shm->config.processes, shm->config.resources);
+	int16_t* available = banker_available(state);
+	int16_t* shared = banker_shared(state);
+	for (int j = 0; j < state->num_res; j++) {
+		available[j] = shm_descr(shm, j)->resource;
+		shared[j] = shm_descr(shm, j)->is_shared;
+	}
+}
+
+// Public function to add a process whose max_res has been filled in and holds nothing
+void banker_admit(struct oss_shm* shm, int sim_pid) {
+	struct banker_state* state = shm_banker(shm);
+	int16_t* max_res = pcb_max_res(shm, sim_pid);
+	int16_t* allow_res = pcb_allow_res(shm, sim_pid);
+	int16_t* need = banker_need(state, sim_pid);
+	int16_t* alloc = banker_alloc(state, sim_pid);
+	const int16_t* shared = banker_shared(state);
+	for (int j = 0; j < state->num_res; j++) {
+		allow_res[j] = 0;
+		alloc[j] = 0;
+		need[j] = shared[j] ? 0 : max_res[j];
+	}
+	banker_active(state)[sim_pid / 64] |= 1ULL << (sim_pid % 64);
+}
+
+// Public function to see if granting requests to sim_pid leaves the system in a safe state.
+// The request is applied to the requester's rows for the duration of the check and undone after.
+bool banker_check(struct oss_shm* shm, int sim_pid, const int* requests) {
+	struct banker_state* state = shm_banker(shm);
+	int16_t* available = banker_available(state);
+	int16_t* need = banker_need(state, sim_pid);
+	int16_t* alloc = banker_alloc(state, sim_pid);
+	int16_t work[state->stride];
+	int exclusive[state->num_res];
+	if (!within_claim(shm, state, sim_pid, requests, exclusive)) return false;
+
+	// Request must be within the declared maximum and currently available
+	memset(work, 0, sizeof(work));
+	for (int j = 0; j < state->num_res; j++) {
+		if (exclusive[j] > need[j]) return false;
+		if (exclusive[j] > available[j]) return false;
+		work[j] = available[j] - exclusive[j];
+	}
+
+	for (int j = 0; j < state->num_res; j++) {
+		need[j] -= exclusive[j];
+		alloc[j] += exclusive[j];
+	}
+	bool safe = banker_safe_sequence(state, work);
+	for (int j = 0; j < state->num_res; j++) {
+		need[j] += exclusive[j];
+		alloc[j] -= exclusive[j];
+	}
+	return safe;
+}
+
+// Public function to see if requests can be granted to sim_pid right now, with no safety check.
+// Used by detection mode, which grants optimistically and recovers from deadlock later.
+bool banker_fits(struct oss_shm* shm, int sim_pid, const int* requests) {
+	struct banker_state* state = shm_banker(shm);
+	int16_t* available = banker_available(state);
+	int16_t* need = banker_need(state, sim_pid);
+	int exclusive[state->num_res];
+	if (!within_claim(shm, state, sim_pid, requests, exclusive)) return false;
+	for (int j = 0; j < state->num_res; j++) {
+		if (exclusive[j] > need[j] || exclusive[j] > available[j]) return false;
+	}
+	return true;
+}
+
+// Public function for deadlock detection. Processes marked in waiting are blocked on their row
+// of requests (num_res entries per process); every other active process is assumed able to finish
+// and give back what it holds. Marks the processes that can never finish in deadlocked and
+// returns how many there are.
+int banker_detect(struct oss_shm* shm, const int* requests, const bool* waiting, bool* deadlocked) {
+	struct banker_state* state = shm_banker(shm);
+	const int num_res = state->num_res;
+	int16_t work[state->stride];
+	uint64_t pending[state->mask_words];
+	memcpy(work, banker_available(state), sizeof(work));
+	memcpy(pending, banker_active(state), sizeof(pending));
+	const int16_t* shared = banker_shared(state);
+
+	bool progress = true;
+	while (progress) {
+		progress = false;
+		for (int w = 0; w < state->mask_words; w++) {
+			uint64_t bits = pending[w];
+			while (bits) {
+				int i = w * 64 + __builtin_ctzll(bits);
+				bits &= bits - 1;
+
+				if (waiting[i]) {
+					const int* request = &requests[(size_t)i * num_res];
+					bool fits = true;
+					for (int j = 0; j < num_res; j++) {
+						// Nobody waits on a shared resource
+						if (!shared[j] && request[j] > work[j]) {
+							fits = false;
+							break;
+						}
+					}
+					if (!fits) continue;
+				}
+
+				const int16_t* alloc = banker_alloc(state, i);
+				for (int j = 0; j < num_res; j++) {
+					work[j] += alloc[j];
+				}
+				pending[w] &= ~(1ULL << (i - w * 64));
+				progress = true;
+			}
+		}
+	}
+
+	int count = 0;
+	for (int i = 0; i < state->num_procs; i++) {
+		deadlocked[i] = (pending[i / 64] >> (i % 64)) & 1;
+		if (deadlocked[i]) count++;
+	}
+	return count;
+}
+
+// Public function to allocate requests to sim_pid. Caller should have checked it is safe.
+void banker_grant(struct oss_shm* shm, int sim_pid, const int* requests) {
+	struct banker_state* state = shm_banker(shm);
+	int16_t* available = banker_available(state);
+	int16_t* need = banker_need(state, sim_pid);
+	int16_t* alloc = banker_alloc(state, sim_pid);
+	const int16_t* shared = banker_shared(state);
+	int16_t* allow_res = pcb_allow_res(shm, sim_pid);
+	for (int j = 0; j < state->num_res; j++) {
+		// A shared hold is only recorded for the process, it uses up no instances
+		if (shared[j]) {
+			allow_res[j] += requests[j];
+			continue;
+		}
+		alloc[j] += requests[j];
+		need[j] -= requests[j];
+		available[j] -= requests[j];
+		allow_res[j] = alloc[j];
+	}
+}
+
+// Public function to undo banker_grant of requests, e.g. when a reservation is aborted
+void banker_return(struct oss_shm* shm, int sim_pid, const int* requests) {
+	struct banker_state* state = shm_banker(shm);
+	int16_t* available = banker_available(state);
+	int16_t* need = banker_need(state, sim_pid);
+	int16_t* alloc = banker_alloc(state, sim_pid);
+	const int16_t* shared = banker_shared(state);
+	int16_t* allow_res = pcb_allow_res(shm, sim_pid);
+	for (int j = 0; j < state->num_res; j++) {
+		if (shared[j]) {
+			allow_res[j] -= requests[j];
+			continue;
+		}
+		alloc[j] -= requests[j];
+		need[j] += requests[j];
+		available[j] += requests[j];
+		allow_res[j] = alloc[j];
+	}
+}
+
+// Public function to give back everything sim_pid holds. Returns number of resources released.
+int banker_release(struct oss_shm* shm, int sim_pid) {
+	struct banker_state* state = shm_banker(shm);
+	int16_t* available = banker_available(state);
+	int16_t* need = banker_need(state, sim_pid);
+	int16_t* alloc = banker_alloc(state, sim_pid);
+	int16_t* allow_res = pcb_allow_res(shm, sim_pid);
+	int num_res = 0;
+	for (int j = 0; j < state->num_res; j++) {
+		if (allow_res[j] > 0) num_res++;
+		available[j] += alloc[j];
+		need[j] += alloc[j];
+		alloc[j] = 0;
+		allow_res[j] = 0;
+	}
+	return num_res;
+}
+
+// Public function to release everything sim_pid holds and drop it from the system
+int banker_remove(struct oss_shm* shm, int sim_pid) {
+	struct banker_state* state = shm_banker(shm);
+	int num_res = banker_release(shm, sim_pid);
+	int16_t* need = banker_need(state, sim_pid);
+	int16_t* max_res = pcb_max_res(shm, sim_pid);
+	for (int j = 0; j < state->num_res; j++) {
+		need[j] = 0;
+		max_res[j] = 0;
+	}
+	banker_active(state)[sim_pid / 64] &= ~(1ULL << (sim_pid % 64));
+	return num_res;
+}
@@ -0,0 +1,71 @@
+#ifndef __BANKER_H
+#define __BANKER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Resource rows are padded to a whole number of 256-bit vectors of int16
+#define BANKER_LANES 16
+
+enum Banker_Kernels {KERNEL_AUTO, KERNEL_SCALAR, KERNEL_AVX2};
+
+struct oss_shm;
+
+// Persistent Banker's algorithm state. Maximum lives in the process table;
+// need, allocation and available are kept here as padded int16 rows and are
+// updated incrementally on every grant, release and removal so a safety
+// check never rebuilds them. Allocation is mirrored into the process table
+// for the children to read.
+// Shared resources (marked in the shared row) can be held by any number of
+// processes at once. They are left out of the accounting: their need and
+// allocation stay 0 and a hold only shows up in the process table.
+// The arrays follow this header at the given byte offsets (see banker_layout()).
+struct banker_state {
+    int num_procs;
+    int num_res;
+    int stride;
+    int mask_words;
+    size_t available_off;
+    size_t shared_off;
+    size_t need_off;
+    size_t alloc_off;
+    size_t active_off;
+};
+
+static inline int16_t* banker_available(const struct banker_state* state) {
+    return (int16_t*)((char*)state + state->available_off);
+}
+
+static inline int16_t* banker_shared(const struct banker_state* state) {
+    return (int16_t*)((char*)state + state->shared_off);
+}
+
+static inline int16_t* banker_need(const struct banker_state* state, int sim_pid) {
+    return (int16_t*)((char*)state + state->need_off) + (size_t)sim_pid * state->stride;
+}
+
+static inline int16_t* banker_alloc(const struct banker_state* state, int sim_pid) {
+    return (int16_t*)((char*)state + state->alloc_off) + (size_t)sim_pid * state->stride;
+}
+
+static inline uint64_t* banker_active(const struct banker_state* state) {
+    return (uint64_t*)((char*)state + state->active_off);
+}
+
+size_t banker_size(int num_procs, int num_res);
+void banker_layout(struct banker_state* state, int num_procs, int num_res);
+void banker_init(struct oss_shm* shm);
+void banker_admit(struct oss_shm* shm, int sim_pid);
+bool banker_check(struct oss_shm* shm, int sim_pid, const int* requests);
+bool banker_fits(struct oss_shm* shm, int sim_pid, const int* requests);
+int banker_detect(struct oss_shm* shm, const int* requests, const bool* waiting, bool* deadlocked);
+void banker_grant(struct oss_shm* shm, int sim_pid, const int* requests);
+void banker_return(struct oss_shm* shm, int sim_pid, const int* requests);
+int banker_release(struct oss_shm* shm, int sim_pid);
+int banker_remove(struct oss_shm* shm, int sim_pid);
+bool banker_set_kernel(int kernel);
+const char* banker_kernel_name();
+bool banker_safe_sequence(const struct banker_state* state, int16_t* work);
+
+#endif
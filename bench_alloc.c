@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "shared.h"
+#include "banker.h"
+#include "config.h"
+
+#define MAX_POINTS 16
+
+enum Op_Kinds {OP_REQUEST, OP_RELEASE, OP_TERMINATE};
+
+// One step of a synthetic request stream. Requests and terminations index into the
+// vectors array, a termination for the claim of the process that takes over the slot.
+struct op {
+    int sim_pid;
+    int kind;
+    size_t vector;
+};
+
+extern struct oss_shm* shared_mem;
+static struct oss_config config;
+static struct op* ops = NULL;
+static int* vectors = NULL;
+static int16_t* claims = NULL;
+static long num_ops = 20000;
+static int kernel = KERNEL_AUTO;
+static unsigned int seed = 1;
+
+void help() {
+    printf("Allocator benchmark usage\n");
+    printf("Runs the Banker's check and resource bookkeeping in-process over synthetic\n");
+    printf("process tables and request streams, and prints one CSV row per point.\n");
+    printf("\n");
+    printf("[-h]\tShow this help dialogue.\n");
+    printf("[-n ops]\tOperations per point (default 20000).\n");
+    printf("[-p list]\tComma separated process counts (default 8,18,64,256,1024).\n");
+    printf("[-r list]\tComma separated resource counts (default 4,20,64,256).\n");
+    printf("[-k kernel]\tSafety kernel: auto (default), scalar or avx2.\n");
+    printf("[-s seed]\tSeed for the synthetic tables and streams (default 1).\n");
+    printf("\n");
+}
+
+// Parse a comma separated list of positive ints. Returns the number parsed.
+int parse_list(const char* text, int* values, int max_values) {
+    int count = 0;
+    char* copy = strdup(text);
+    for (char* token = strtok(copy, ","); token != NULL && count < max_values; token = strtok(NULL, ",")) {
+        values[count] = atoi(token);
+        if (values[count] > 0) count++;
+    }
+    free(copy);
+    return count;
+}
+
+uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+// Lay out a private copy of the shm for num_procs x num_res, with resource totals
+// and maximum claims drawn the same way oss draws them
+void build_table(int num_procs, int num_res) {
+    config_defaults(&config);
+    config.processes = num_procs;
+    config.resources = num_res;
+    size_t size = oss_shm_size(&config);
+    shared_mem = aligned_alloc(CACHE_LINE, size);
+    memset(shared_mem, 0, size);
+    oss_shm_layout(shared_mem, &config);
+
+    for (int i = 0; i < num_res; i++) {
+        shm_descr(shared_mem, i)->resource = (rand() % 10) + 1;
+    }
+    // Keep the starting claims, as the stream replaces them when processes terminate
+    claims = realloc(claims, (size_t)num_procs * num_res * sizeof(int16_t));
+    for (int p = 0; p < num_procs; p++) {
+        for (int i = 0; i < num_res; i++) {
+            claims[p * num_res + i] = rand() % (shm_descr(shared_mem, i)->resource + 1);
+        }
+    }
+}
+
+// Replace sim_pid with a new process holding claim, as oss does when a slot is reused
+void readmit(int sim_pid, const int* claim) {
+    int16_t* max_res = pcb_max_res(shared_mem, sim_pid);
+    banker_remove(shared_mem, sim_pid);
+    for (int i = 0; i < config.resources; i++) {
+        max_res[i] = claim[i];
+    }
+    banker_admit(shared_mem, sim_pid);
+}
+
+// Put every process back to its starting claim, holding nothing
+void reset_table() {
+    banker_init(shared_mem);
+    for (int p = 0; p < config.processes; p++) {
+        memcpy(pcb_max_res(shared_mem, p), &claims[p * config.resources], config.resources * sizeof(int16_t));
+        banker_admit(shared_mem, p);
+    }
+}
+
+// Record a stream of requests, releases and terminations against a live table so each
+// request stays within its process's need, the way user_proc builds its requests
+void build_stream() {
+    int num_res = config.resources;
+    ops = realloc(ops, num_ops * sizeof(struct op));
+    vectors = realloc(vectors, num_ops * num_res * sizeof(int));
+    bool* holding = calloc(config.processes, sizeof(bool));
+    reset_table();
+
+    for (long n = 0; n < num_ops; n++) {
+        int sim_pid = rand() % config.processes;
+        int roll = rand() % 100;
+        ops[n].sim_pid = sim_pid;
+        ops[n].vector = n * num_res;
+
+        // Roughly the mix user_proc produces: mostly requests, some releases, few exits
+        if (roll < 2) {
+            // The next process in the slot draws a fresh claim, the same way oss draws one
+            ops[n].kind = OP_TERMINATE;
+            int* claim = &vectors[ops[n].vector];
+            for (int i = 0; i < num_res; i++) {
+                claim[i] = rand() % (shm_descr(shared_mem, i)->resource + 1);
+            }
+            readmit(sim_pid, claim);
+            holding[sim_pid] = false;
+        }
+        else if (roll < 30 && holding[sim_pid]) {
+            ops[n].kind = OP_RELEASE;
+            banker_release(shared_mem, sim_pid);
+            holding[sim_pid] = false;
+        }
+        else {
+            ops[n].kind = OP_REQUEST;
+            int* request = &vectors[ops[n].vector];
+            int16_t* max_res = pcb_max_res(shared_mem, sim_pid);
+            int16_t* allow_res = pcb_allow_res(shared_mem, sim_pid);
+            for (int i = 0; i < num_res; i++) {
+                request[i] = rand() % (max_res[i] - allow_res[i] + 1);
+            }
+            if (banker_check(shared_mem, sim_pid, request)) {
+                banker_grant(shared_mem, sim_pid, request);
+                holding[sim_pid] = true;
+            }
+        }
+    }
+    free(holding);
+}
+
+// Run the recorded stream from a fresh table and print its CSV row
+void run_point() {
+    long checks = 0, safe = 0, releases = 0, terminations = 0;
+    uint64_t check_cycles = 0;
+    reset_table();
+
+    uint64_t start_cycles = __rdtsc();
+    uint64_t start = now_ns();
+    for (long n = 0; n < num_ops; n++) {
+        int sim_pid = ops[n].sim_pid;
+        switch (ops[n].kind) {
+            case OP_REQUEST: {
+                int* request = &vectors[ops[n].vector];
+                uint64_t before = __rdtsc();
+                bool allowed = banker_check(shared_mem, sim_pid, request);
+                check_cycles += __rdtsc() - before;
+                checks++;
+                if (allowed) {
+                    banker_grant(shared_mem, sim_pid, request);
+                    safe++;
+                }
+                break;
+            }
+            case OP_RELEASE:
+                banker_release(shared_mem, sim_pid);
+                releases++;
+                break;
+            case OP_TERMINATE:
+                readmit(sim_pid, &vectors[ops[n].vector]);
+                terminations++;
+                break;
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    uint64_t elapsed_cycles = __rdtsc() - start_cycles;
+    if (elapsed == 0) elapsed = 1;
+
+    // TSC cycles are converted to time with the rate measured over the whole run
+    double secs = (double)elapsed / NS_PER_SEC;
+    double cycles_per_ns = (double)elapsed_cycles / elapsed;
+    double cycles_per_check = checks > 0 ? (double)check_cycles / checks : 0.0;
+    printf("%s,%d,%d,%ld,%ld,%ld,%ld,%ld,%.0f,%.0f,%.0f,%.1f,%.1f\n", banker_kernel_name(),
+        config.processes, config.resources, num_ops, checks, safe, releases, terminations,
+        num_ops / secs, checks / secs, safe / secs,
+        cycles_per_ns > 0.0 ? cycles_per_check / cycles_per_ns : 0.0, cycles_per_check);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    int option;
+    int procs[MAX_POINTS] = {8, 18, 64, 256, 1024};
+    int res[MAX_POINTS] = {4, 20, 64, 256};
+    int num_procs = 5, num_res = 4;
+
+    while ((option = getopt(argc, argv, "hk:n:p:r:s:")) != -1) {
+        switch (option) {
+            case 'h':
+                help();
+                exit(EXIT_SUCCESS);
+            case 'k':
+                if (strcmp(optarg, "scalar") == 0) kernel = KERNEL_SCALAR;
+                else if (strcmp(optarg, "avx2") == 0) kernel = KERNEL_AVX2;
+                else if (strcmp(optarg, "auto") != 0) {
+                    fprintf(stderr, "%s: unknown kernel %s\n", argv[0], optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'n':
+                num_ops = atol(optarg);
+                break;
+            case 'p':
+                num_procs = parse_list(optarg, procs, MAX_POINTS);
+                break;
+            case 'r':
+                num_res = parse_list(optarg, res, MAX_POINTS);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            case '?':
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (num_ops < 1 || num_procs < 1 || num_res < 1) {
+        fprintf(stderr, "%s: need at least one op, process count and resource count\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (!banker_set_kernel(kernel)) {
+        fprintf(stderr, "%s: kernel not supported on this CPU\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("kernel,processes,resources,ops,checks,safe,releases,terminations,ops_per_sec,checks_per_sec,grants_per_sec,ns_per_check,cycles_per_check\n");
+    for (int p = 0; p < num_procs; p++) {
+        for (int r = 0; r < num_res; r++) {
+            if (procs[p] > PROCESSES_LIMIT || res[r] > RESOURCES_LIMIT) {
+                fprintf(stderr, "Skipping %d x %d, over the limits in config.h\n", procs[p], res[r]);
+                continue;
+            }
+            srand(seed);
+            build_table(procs[p], res[r]);
+            build_stream();
+            run_point();
+            free(shared_mem);
+            shared_mem = NULL;
+        }
+    }
+
+    free(ops);
+    free(vectors);
+    free(claims);
+    exit(EXIT_SUCCESS);
+}
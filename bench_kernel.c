@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "banker.h"
+#include "config.h"
+
+#define NUM_STATES 64
+
+static struct banker_state* states[NUM_STATES];
+static int16_t* works[NUM_STATES];
+static int num_procs = MAX_PROCESSES;
+static int num_res = MAX_RES_INSTANCES;
+
+void help() {
+    printf("Banker's safety kernel micro-benchmark usage\n");
+    printf("\n");
+    printf("[-h]\tShow this help dialogue.\n");
+    printf("[-n iterations]\tNumber of safety checks per kernel (default 1000000).\n");
+    printf("[-p processes]\tNumber of processes (default %d).\n", MAX_PROCESSES);
+    printf("[-r resources]\tNumber of resources (default %d).\n", MAX_RES_INSTANCES);
+    printf("\n");
+}
+
+// Fill states with random need/allocation rows giving a mix of safe and unsafe states
+void build_states() {
+    size_t size = (banker_size(num_procs, num_res) + 63) / 64 * 64;
+    for (int s = 0; s < NUM_STATES; s++) {
+        states[s] = aligned_alloc(64, size);
+        banker_layout(states[s], num_procs, num_res);
+        works[s] = calloc(states[s]->stride, sizeof(int16_t));
+        for (int i = 0; i < num_procs; i++) {
+            banker_active(states[s])[i / 64] |= 1ULL << (i % 64);
+            for (int j = 0; j < num_res; j++) {
+                banker_need(states[s], i)[j] = rand() % 3;
+                banker_alloc(states[s], i)[j] = rand() % 3;
+            }
+        }
+        for (int j = 0; j < num_res; j++) {
+            works[s][j] = rand() % 6;
+        }
+    }
+}
+
+// Run iterations safety checks with the current kernel. Returns nanoseconds per check.
+double run_kernel(long iterations, int* num_safe) {
+    int16_t work[states[0]->stride];
+    struct timespec start, end;
+    *num_safe = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long n = 0; n < iterations; n++) {
+        int s = n % NUM_STATES;
+        memcpy(work, works[s], sizeof(work));
+        if (banker_safe_sequence(states[s], work)) (*num_safe)++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    return elapsed / iterations;
+}
+
+int main(int argc, char** argv) {
+    int option;
+    long iterations = 1000000;
+
+    while ((option = getopt(argc, argv, "hn:p:r:")) != -1) {
+        switch (option) {
+            case 'h':
+                help();
+                exit(EXIT_SUCCESS);
+            case 'n':
+                iterations = atol(optarg);
+                break;
+            case 'p':
+                num_procs = atoi(optarg);
+                break;
+            case 'r':
+                num_res = atoi(optarg);
+                break;
+            case '?':
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    srand(1);
+    build_states();
+
+    int kernels[] = {KERNEL_SCALAR, KERNEL_AVX2};
+    int scalar_safe = -1;
+    printf("%d processes x %d resources, %ld checks per kernel\n", num_procs, num_res, iterations);
+    for (int k = 0; k < 2; k++) {
+        if (!banker_set_kernel(kernels[k])) {
+            printf("%-8s unsupported on this CPU\n", k == 0 ? "scalar" : "avx2");
+            continue;
+        }
+        int num_safe;
+        double ns = run_kernel(iterations, &num_safe);
+        printf("%-8s %8.1f ns/check  %ld safe\n", banker_kernel_name(), ns, (long)num_safe);
+
+        // Both kernels must agree on every state
+        if (scalar_safe < 0) scalar_safe = num_safe;
+        else if (scalar_safe != num_safe) {
+            fprintf(stderr, "Kernel results differ!\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    exit(EXIT_SUCCESS);
+}
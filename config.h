@@ -5,17 +5,37 @@
 
 #define LOG_FILE_MAX 100000
 #define LOG_FILE "logfile.log"
+#define LOG_FILE_KEEP 4 // Rotated log files kept (logfile.log.1 ... .4)
+#define LOG_BUFFER_SIZE (1 << 20) // 1 MiB in-memory log buffer
 #define VERBOSE_MODE true
-#define MAX_PROCESSES 18
+#define METRICS_PUBLISH_NS 10000000 // Wall time between updates of the shared metrics page (10ms)
+#define STOP_CHECK_MS 100 // How often a wait on a silent child checks for SIGINT/SIGALRM
+#define STATS_JSON_FILE "stats.json" // Statistics export, written at exit and on SIGUSR1
 #define SHM_FILE "shmOSS.shm"
-#define MSG_BUFFER_LEN 2048
+
+// Defaults for the runtime configuration (see oss -f and -o).
+#define MAX_PROCESSES 18
 #define MAX_RES_INSTANCES 20
 #define MAX_RUNTIME 300 // 5m
 #define MAX_RUN_PROCS 40 // Max number of processes to run
+#define BATCH_OPS 1 // Operations a user_proc sends per scheduling turn (1 is one message per operation)
 
 #define maxTimeBetweenNewProcsSecs 0
 #define minTimeBetweenNewProcsSecs 0
 #define minTimeBetweenNewProcsNS 1000000 // 1 ms
 #define maxTimeBetweenNewProcsNS 500000000 // 500 ms
+#define STATS_INTERVAL_SECS 60 // Simulated seconds between logged stats snapshots
+#define DETECT_INTERVAL_SECS 5 // Simulated seconds between deadlock detection passes (-m detect)
+#define ROLLBACK_COST 10 // Victim cost added per earlier rollback so one process is not always picked
+#define SHARED_RES_PCT 20 // Percent of resource descriptors that are shareable
+#define ZIPF_EXPONENT 1.0 // Skew of resource popularity for request_dist = zipf
+#define ZIPF_DRAWS 4 // Resources drawn per zipf request (repeats merge)
+#define BURST_SWITCH_PCT 10 // Chance per request that a bursty process flips between quiet and burst
+
+// Hard limits on the runtime configuration
+#define PROCESSES_LIMIT 4096
+#define RESOURCES_LIMIT 512 // Sizes the resource vector of a message
+#define SHARDS_LIMIT 16 // Allocator shard processes (-o shards)
+#define BATCH_LIMIT 64 // Operations per batch message (-o batch)
 
 #endif
@@ -0,0 +1,146 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "dispatcher.h"
+#include "queue.h"
+
+// Pool of threads that each serve one process's scheduling turn at a time.
+// The main thread submits sim_pids and collects their outcomes, so a child
+// that is slow to answer only holds up the thread serving it.
+static pthread_t* threads = NULL;
+static int num_threads = 0;
+static dispatch_fn serve_fn = NULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t has_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t has_result = PTHREAD_COND_INITIALIZER;
+static struct Queue pending;
+static struct Queue completed;
+static int* outcomes = NULL;
+static int in_flight = 0;
+static bool running = false;
+static int notify_fd = -1;
+
+// Private thread body: serve submitted processes until stopped
+static void* dispatcher_main(void* arg) {
+	pthread_mutex_lock(&lock);
+	while (true) {
+		while (queue_is_empty(&pending) && running) {
+			pthread_cond_wait(&has_work, &lock);
+		}
+		if (!running) break;
+
+		int sim_pid = queue_pop(&pending);
+		pthread_mutex_unlock(&lock);
+
+		int outcome = serve_fn(sim_pid);
+
+		pthread_mutex_lock(&lock);
+		outcomes[sim_pid] = outcome;
+		queue_insert(&completed, sim_pid);
+		pthread_cond_signal(&has_result);
+		if (notify_fd >= 0) {
+			uint64_t one = 1;
+			if (write(notify_fd, &one, sizeof(one)) < 0) perror("Could not signal finished turn");
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+// Public function to start count threads serving up to max_procs process slots with serve
+void dispatcher_start(int count, int max_procs, dispatch_fn serve) {
+	serve_fn = serve;
+	queue_init(&pending, max_procs);
+	queue_init(&completed, max_procs);
+	outcomes = calloc(max_procs, sizeof(int));
+	threads = calloc(count, sizeof(pthread_t));
+	in_flight = 0;
+	running = true;
+
+	// Leave signal handling to the main thread
+	sigset_t mask, old_mask;
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+	for (int i = 0; i < count; i++) {
+		if (pthread_create(&threads[i], NULL, dispatcher_main, NULL) != 0) {
+			perror("Could not start dispatcher thread");
+			break;
+		}
+		num_threads++;
+	}
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+// Public function to stop the threads once they finish their current turn
+void dispatcher_stop() {
+	pthread_mutex_lock(&lock);
+	running = false;
+	pthread_cond_broadcast(&has_work);
+	pthread_mutex_unlock(&lock);
+
+	for (int i = 0; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	free(outcomes);
+	queue_free(&pending);
+	queue_free(&completed);
+	threads = NULL;
+	outcomes = NULL;
+	num_threads = 0;
+}
+
+// Public function to also count every finished turn on the eventfd fd, so the main
+// thread can wait on turns alongside its other events. Pass -1 to stop.
+void dispatcher_notify(int fd) {
+	pthread_mutex_lock(&lock);
+	notify_fd = fd;
+	pthread_mutex_unlock(&lock);
+}
+
+// Public function to hand a process's turn to the next free thread
+void dispatcher_submit(int sim_pid) {
+	pthread_mutex_lock(&lock);
+	queue_insert(&pending, sim_pid);
+	in_flight++;
+	pthread_cond_signal(&has_work);
+	pthread_mutex_unlock(&lock);
+}
+
+// Public function to collect a finished turn. Returns false if none is ready and we are not waiting.
+bool dispatcher_complete(struct dispatch_result* result, bool wait) {
+	pthread_mutex_lock(&lock);
+	while (queue_is_empty(&completed)) {
+		if (!wait || in_flight == 0) {
+			pthread_mutex_unlock(&lock);
+			return false;
+		}
+		pthread_cond_wait(&has_result, &lock);
+	}
+	result->sim_pid = queue_pop(&completed);
+	result->outcome = outcomes[result->sim_pid];
+	in_flight--;
+	pthread_mutex_unlock(&lock);
+	return true;
+}
+
+// Public function to get the number of threads not serving a turn
+int dispatcher_idle() {
+	pthread_mutex_lock(&lock);
+	int idle = num_threads - in_flight;
+	pthread_mutex_unlock(&lock);
+	return idle;
+}
+
+// Public function to get the number of turns submitted but not yet collected
+int dispatcher_in_flight() {
+	pthread_mutex_lock(&lock);
+	int count = in_flight;
+	pthread_mutex_unlock(&lock);
+	return count;
+}
@@ -0,0 +1,22 @@
+#ifndef __DISPATCHER_H
+#define __DISPATCHER_H
+
+#include <stdbool.h>
+
+// Serves one scheduling turn for sim_pid and returns an outcome for the caller
+typedef int (*dispatch_fn)(int sim_pid);
+
+struct dispatch_result {
+    int sim_pid;
+    int outcome;
+};
+
+void dispatcher_start(int threads, int max_procs, dispatch_fn serve);
+void dispatcher_stop();
+void dispatcher_notify(int fd);
+void dispatcher_submit(int sim_pid);
+bool dispatcher_complete(struct dispatch_result* result, bool wait);
+int dispatcher_idle();
+int dispatcher_in_flight();
+
+#endif
@@ -0,0 +1,88 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "event.h"
+
+// Private function to see if event a should run before event b
+static bool event_before(const struct event* a, const struct event* b) {
+	if (a->time != b->time) return a->time < b->time;
+	return a->seq < b->seq;
+}
+
+// Private function to swap two heap entries
+static void event_swap(struct event* a, struct event* b) {
+	struct event tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+void event_queue_init(struct event_queue* queue) {
+	queue->capacity = 16;
+	queue->heap = malloc(queue->capacity * sizeof(struct event));
+	queue->size = 0;
+	queue->next_seq = 0;
+}
+
+void event_queue_free(struct event_queue* queue) {
+	free(queue->heap);
+	queue->heap = NULL;
+	queue->size = 0;
+	queue->capacity = 0;
+}
+
+// Public function to schedule an event of type at simulated time
+void event_push(struct event_queue* queue, uint64_t time, int type, int arg) {
+	if (queue->size == queue->capacity) {
+		struct event* heap = realloc(queue->heap, queue->capacity * 2 * sizeof(struct event));
+		if (heap == NULL) {
+			perror("Could not grow event queue");
+			return;
+		}
+		queue->heap = heap;
+		queue->capacity *= 2;
+	}
+
+	// Sift the new event up to its place
+	size_t i = queue->size++;
+	queue->heap[i].time = time;
+	queue->heap[i].seq = queue->next_seq++;
+	queue->heap[i].type = type;
+	queue->heap[i].arg = arg;
+	while (i > 0 && event_before(&queue->heap[i], &queue->heap[(i - 1) / 2])) {
+		event_swap(&queue->heap[i], &queue->heap[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+}
+
+// Public function to take the earliest event. Returns false if there are none.
+bool event_pop(struct event_queue* queue, struct event* event) {
+	if (queue->size == 0) return false;
+	*event = queue->heap[0];
+	queue->heap[0] = queue->heap[--queue->size];
+
+	// Sift the moved event down to its place
+	size_t i = 0;
+	while (true) {
+		size_t smallest = i;
+		size_t left = 2 * i + 1;
+		size_t right = 2 * i + 2;
+		if (left < queue->size && event_before(&queue->heap[left], &queue->heap[smallest])) smallest = left;
+		if (right < queue->size && event_before(&queue->heap[right], &queue->heap[smallest])) smallest = right;
+		if (smallest == i) break;
+		event_swap(&queue->heap[i], &queue->heap[smallest]);
+		i = smallest;
+	}
+	return true;
+}
+
+// Public function to look at the earliest event without removing it
+bool event_peek(struct event_queue* queue, struct event* event) {
+	if (queue->size == 0) return false;
+	*event = queue->heap[0];
+	return true;
+}
+
+bool event_queue_is_empty(struct event_queue* queue) {
+	return queue->size == 0;
+}
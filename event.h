@@ -0,0 +1,34 @@
+#ifndef __EVENT_H
+#define __EVENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum Event_Types {EVENT_SPAWN, EVENT_DISPATCH, EVENT_CHILD_EXIT, EVENT_STATS, EVENT_DETECT};
+
+// A timestamped simulation event. Events at the same time run in the order
+// they were scheduled.
+struct event {
+    uint64_t time;
+    uint64_t seq;
+    int type;
+    int arg;
+};
+
+// Binary min-heap of events ordered by (time, seq)
+struct event_queue {
+    struct event* heap;
+    size_t size;
+    size_t capacity;
+    uint64_t next_seq;
+};
+
+void event_queue_init(struct event_queue* queue);
+void event_queue_free(struct event_queue* queue);
+void event_push(struct event_queue* queue, uint64_t time, int type, int arg);
+bool event_pop(struct event_queue* queue, struct event* event);
+bool event_peek(struct event_queue* queue, struct event* event);
+bool event_queue_is_empty(struct event_queue* queue);
+
+#endif
@@ -0,0 +1,82 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "histogram.h"
+
+// Private function to map a value to its bucket
+static int bucket_index(uint64_t value) {
+	if (value < 2 * HIST_SUB_COUNT) return (int)value;
+	int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+	return (shift + 1) * HIST_SUB_COUNT + (int)(value >> shift) - HIST_SUB_COUNT;
+}
+
+// Private function to get the highest value that maps to a bucket
+static uint64_t bucket_value(int index) {
+	if (index < 2 * HIST_SUB_COUNT) return (uint64_t)index;
+	int shift = index / HIST_SUB_COUNT - 1;
+	uint64_t base = (uint64_t)(index % HIST_SUB_COUNT + HIST_SUB_COUNT) << shift;
+	return base + ((1ULL << shift) - 1);
+}
+
+void hist_init(struct histogram* hist) {
+	memset(hist, 0, sizeof(*hist));
+	hist->min = UINT64_MAX;
+}
+
+// Public function to count one value
+void hist_record(struct histogram* hist, uint64_t value) {
+	__atomic_add_fetch(&hist->counts[bucket_index(value)], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&hist->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&hist->sum, value, __ATOMIC_RELAXED);
+
+	uint64_t current = __atomic_load_n(&hist->min, __ATOMIC_RELAXED);
+	while (value < current && !__atomic_compare_exchange_n(&hist->min, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	current = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+	while (value > current && !__atomic_compare_exchange_n(&hist->max, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// Public function to get the value at or below which percentile (0-100) of the values fall
+uint64_t hist_percentile(const struct histogram* hist, double percentile) {
+	uint64_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+	if (count == 0) return 0;
+	uint64_t target = (uint64_t)(percentile / 100.0 * count + 0.5);
+	if (target < 1) target = 1;
+
+	uint64_t seen = 0;
+	for (int i = 0; i < HIST_BUCKETS; i++) {
+		seen += __atomic_load_n(&hist->counts[i], __ATOMIC_RELAXED);
+		if (seen >= target) {
+			// Never report past the largest value actually recorded
+			uint64_t value = bucket_value(i);
+			return value < hist->max ? value : hist->max;
+		}
+	}
+	return hist->max;
+}
+
+double hist_mean(const struct histogram* hist) {
+	if (hist->count == 0) return 0.0;
+	return (double)hist->sum / hist->count;
+}
+
+// Public function to print one summary line, with values divided by scale to get unit
+void hist_print(FILE* file, const char* name, const struct histogram* hist, double scale, const char* unit) {
+	if (hist->count == 0) {
+		fprintf(file, "\t%-22s no samples\n", name);
+		return;
+	}
+	fprintf(file, "\t%-22s n=%-8lu mean %.1f  p50 %.1f  p99 %.1f  p999 %.1f  max %.1f %s\n", name,
+		(unsigned long)hist->count, hist_mean(hist) / scale,
+		hist_percentile(hist, 50.0) / scale, hist_percentile(hist, 99.0) / scale,
+		hist_percentile(hist, 99.9) / scale, hist->max / scale, unit);
+}
+
+// Public function to write the summary as a JSON object
+void hist_json(FILE* file, const struct histogram* hist) {
+	fprintf(file, "{\"count\": %lu, \"min\": %lu, \"mean\": %.1f, \"p50\": %lu, \"p90\": %lu, \"p99\": %lu, \"p999\": %lu, \"max\": %lu}",
+		(unsigned long)hist->count, (unsigned long)(hist->count ? hist->min : 0), hist_mean(hist),
+		(unsigned long)hist_percentile(hist, 50.0), (unsigned long)hist_percentile(hist, 90.0),
+		(unsigned long)hist_percentile(hist, 99.0), (unsigned long)hist_percentile(hist, 99.9),
+		(unsigned long)hist->max);
+}
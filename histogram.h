@@ -0,0 +1,32 @@
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Log-linear (HDR-style) histogram of uint64 values. Values below
+// 2^(HIST_SUB_BITS + 1) are counted exactly. Above that, every power of two is
+// split into 2^HIST_SUB_BITS buckets, so any recorded value is reported within
+// about 1.6% across the whole 64-bit range in a fixed ~30KB.
+#define HIST_SUB_BITS 6
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+// Recording is lock-free, so dispatcher threads can record concurrently
+struct histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t counts[HIST_BUCKETS];
+};
+
+void hist_init(struct histogram* hist);
+void hist_record(struct histogram* hist, uint64_t value);
+uint64_t hist_percentile(const struct histogram* hist, double percentile);
+double hist_mean(const struct histogram* hist);
+void hist_print(FILE* file, const char* name, const struct histogram* hist, double scale, const char* unit);
+void hist_json(FILE* file, const struct histogram* hist);
+
+#endif
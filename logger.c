@@ -0,0 +1,182 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "logger.h"
+#include "config.h"
+
+// Byte ring buffer of newline terminated log lines. The scheduler appends
+// under the mutex with a memcpy; a background thread drains it to the file.
+static char buffer[LOG_BUFFER_SIZE];
+static size_t head = 0;
+static size_t tail = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t has_data = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t has_space = PTHREAD_COND_INITIALIZER;
+static pthread_t writer;
+static bool running = false;
+static bool drop_when_full = false;
+static unsigned long dropped = 0;
+
+static char log_path[256];
+static int log_fd = -1;
+static unsigned long file_lines = 0;
+
+// Private function to move logfile.log -> logfile.log.1 -> ... and start a fresh file
+static void rotate() {
+	char from[300];
+	char to[300];
+	close(log_fd);
+	for (int i = LOG_FILE_KEEP - 1; i > 0; i--) {
+		snprintf(from, sizeof(from), "%s.%d", log_path, i);
+		snprintf(to, sizeof(to), "%s.%d", log_path, i + 1);
+		rename(from, to);
+	}
+	snprintf(to, sizeof(to), "%s.1", log_path);
+	rename(log_path, to);
+
+	log_fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (log_fd < 0) perror("Could not open logfile");
+	file_lines = 0;
+}
+
+// Private function to write len bytes starting at ring offset start, rotating at LOG_FILE_MAX lines
+static void write_span(size_t start, size_t len) {
+	while (len > 0) {
+		// Find how much of the span fits in the current file
+		size_t chunk = 0;
+		unsigned long lines = 0;
+		while (chunk < len && file_lines + lines < LOG_FILE_MAX) {
+			if (buffer[(start + chunk) % LOG_BUFFER_SIZE] == '\n') lines++;
+			chunk++;
+		}
+
+		// Span may wrap around the end of the ring
+		struct iovec iov[2];
+		int iovcnt = 1;
+		size_t offset = start % LOG_BUFFER_SIZE;
+		iov[0].iov_base = &buffer[offset];
+		iov[0].iov_len = chunk;
+		if (offset + chunk > LOG_BUFFER_SIZE) {
+			iov[0].iov_len = LOG_BUFFER_SIZE - offset;
+			iov[1].iov_base = buffer;
+			iov[1].iov_len = chunk - iov[0].iov_len;
+			iovcnt = 2;
+		}
+		if (log_fd >= 0 && writev(log_fd, iov, iovcnt) < 0) {
+			perror("Could not write to logfile");
+		}
+
+		file_lines += lines;
+		start += chunk;
+		len -= chunk;
+		if (file_lines >= LOG_FILE_MAX) rotate();
+	}
+}
+
+// Private writer thread. Drains everything buffered in one batch per wakeup.
+static void* writer_main(void* arg) {
+	pthread_mutex_lock(&lock);
+	while (true) {
+		while (head == tail && running) {
+			pthread_cond_wait(&has_data, &lock);
+		}
+		if (head == tail && !running) break;
+
+		size_t start = head;
+		size_t len = tail - head;
+		pthread_mutex_unlock(&lock);
+
+		write_span(start, len);
+
+		pthread_mutex_lock(&lock);
+		head += len;
+		pthread_cond_broadcast(&has_space);
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+// Public function to truncate the log at path and start the writer thread.
+// With nonblocking set, lines that do not fit in the buffer are dropped and counted.
+void log_open(const char* path, bool nonblocking) {
+	strncpy(log_path, path, sizeof(log_path) - 1);
+	log_fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (log_fd < 0) {
+		perror("Could not open logfile");
+	}
+	file_lines = 0;
+	drop_when_full = nonblocking;
+	dropped = 0;
+	head = tail = 0;
+	running = true;
+
+	// Keep signals on the scheduling thread
+	sigset_t mask, old_mask;
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+	if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+		perror("Could not start log writer");
+		running = false;
+	}
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+// Public function to queue a line of text for the log
+void log_write(const char* text) {
+	size_t len = strlen(text);
+	if (len + 1 > LOG_BUFFER_SIZE) len = LOG_BUFFER_SIZE - 1;
+
+	pthread_mutex_lock(&lock);
+	if (!running) {
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+	while (LOG_BUFFER_SIZE - (tail - head) < len + 1) {
+		if (drop_when_full) {
+			dropped++;
+			pthread_mutex_unlock(&lock);
+			return;
+		}
+		pthread_cond_wait(&has_space, &lock);
+	}
+
+	// Copy in up to two pieces if we wrap around the ring
+	size_t offset = tail % LOG_BUFFER_SIZE;
+	size_t first = len < LOG_BUFFER_SIZE - offset ? len : LOG_BUFFER_SIZE - offset;
+	memcpy(&buffer[offset], text, first);
+	memcpy(buffer, text + first, len - first);
+	buffer[(tail + len) % LOG_BUFFER_SIZE] = '\n';
+	tail += len + 1;
+
+	pthread_cond_signal(&has_data);
+	pthread_mutex_unlock(&lock);
+}
+
+// Public function to flush everything buffered and stop the writer thread
+void log_close() {
+	pthread_mutex_lock(&lock);
+	if (!running) {
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+	running = false;
+	pthread_cond_signal(&has_data);
+	pthread_mutex_unlock(&lock);
+
+	pthread_join(writer, NULL);
+	if (log_fd >= 0) close(log_fd);
+	log_fd = -1;
+}
+
+// Public function to get the number of lines dropped in nonblocking mode
+unsigned long log_dropped() {
+	return dropped;
+}
@@ -0,0 +1,12 @@
+#ifndef __LOGGER_H
+#define __LOGGER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+void log_open(const char* path, bool nonblocking);
+void log_write(const char* text);
+void log_close();
+unsigned long log_dropped();
+
+#endif
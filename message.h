@@ -0,0 +1,30 @@
+#ifndef __MESSAGE_H
+#define __MESSAGE_H
+
+#include <stdint.h>
+#include "config.h"
+
+// Version of the binary message layout below. Bump on any layout change.
+#define MSG_VERSION 3
+
+enum Msg_Opcodes {MSG_RUN, MSG_REQUEST, MSG_RELEASE, MSG_TERMINATE, MSG_ACQUIRED, MSG_DENIED, MSG_RESET, MSG_EXIT,
+    MSG_SHARD_ADMIT, MSG_SHARD_RESERVE, MSG_SHARD_ABORT, MSG_SHARD_RELEASE, MSG_SHARD_REMOVE,
+    MSG_BATCH, MSG_RESULTS, MSG_PARKED};
+
+// Fixed-layout binary message. Only the header is sent unless the opcode
+// carries a resource vector, and then only num_res entries of it (see msg_size()).
+// A MSG_BATCH holds num_ops opcodes in resources, followed by one vector of
+// config.resources entries per MSG_REQUEST among them, and num_res counts every
+// entry used. Its MSG_RESULTS reply holds one reply opcode per operation served:
+// MSG_ACQUIRED, MSG_DENIED or MSG_PARKED for requests, the opcode itself otherwise.
+struct message {
+    long int msg_type;
+    uint8_t version;
+    uint8_t opcode;
+    int16_t sim_pid;
+    uint16_t num_res;
+    uint16_t num_ops;
+    int16_t resources[RESOURCES_LIMIT];
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+// Public function to get the bytes needed for the metrics page with num_res resources
+size_t metrics_size(int num_res) {
+	return sizeof(struct oss_metrics) + 2 * num_res * sizeof(int16_t);
+}
+
+void metrics_init(struct oss_metrics* metrics, int num_res) {
+	memset(metrics, 0, metrics_size(num_res));
+	metrics->num_res = num_res;
+	metrics->oss_pid = getpid();
+	metrics->running = 1;
+	__atomic_store_n(&metrics->version, METRICS_VERSION, __ATOMIC_RELEASE);
+}
+
+// Public function to start an update. Readers retry until metrics_end().
+void metrics_begin(struct oss_metrics* metrics) {
+	__atomic_store_n(&metrics->seq, metrics->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void metrics_end(struct oss_metrics* metrics) {
+	__atomic_store_n(&metrics->seq, metrics->seq + 1, __ATOMIC_RELEASE);
+}
+
+// Public function to mark oss as finished so monitors can exit
+void metrics_stop(struct oss_metrics* metrics) {
+	metrics_begin(metrics);
+	metrics->running = 0;
+	metrics_end(metrics);
+}
+
+// Public function to take a consistent copy of the page. allocated and total receive
+// num_res entries each. Returns false if the page is not one this build understands.
+bool metrics_read(const struct oss_metrics* metrics, struct oss_metrics* copy, int16_t* allocated, int16_t* total) {
+	if (__atomic_load_n(&metrics->version, __ATOMIC_ACQUIRE) != METRICS_VERSION) return false;
+	size_t res_bytes = metrics->num_res * sizeof(int16_t);
+	const int16_t* res = (const int16_t*)(metrics + 1);
+
+	while (true) {
+		uint32_t seq = __atomic_load_n(&metrics->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			usleep(10);
+			continue;
+		}
+		memcpy(copy, metrics, sizeof(*copy));
+		memcpy(allocated, res, res_bytes);
+		memcpy(total, res + metrics->num_res, res_bytes);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&metrics->seq, __ATOMIC_RELAXED) == seq) return true;
+	}
+}
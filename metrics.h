@@ -0,0 +1,53 @@
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define METRICS_VERSION 1
+
+// Live metrics page that oss publishes in shared memory for monitors such as
+// oss_top. Guarded by a seqlock: oss makes seq odd while it writes and even
+// again when done, and a reader retries until it sees the same even seq before
+// and after its copy, so readers never block or slow the scheduler.
+// Followed by num_res allocated counts then num_res totals (see metrics_size()).
+struct oss_metrics {
+    uint32_t version;
+    uint32_t seq;
+    uint32_t running;
+    uint32_t num_res;
+    pid_t oss_pid;
+    uint64_t sim_time_ns;
+    uint64_t wall_time_ns;
+    uint32_t granted;
+    uint32_t denied;
+    uint32_t parked;
+    uint32_t terminations;
+    uint32_t releases;
+    uint32_t deadlocks;
+    uint32_t rollbacks;
+    uint32_t ready;
+    uint32_t blocked;
+    uint32_t waiting;
+    uint32_t children;
+    uint32_t total_procs;
+};
+
+static inline int16_t* metrics_allocated(struct oss_metrics* metrics) {
+    return (int16_t*)(metrics + 1);
+}
+
+static inline int16_t* metrics_total(struct oss_metrics* metrics) {
+    return (int16_t*)(metrics + 1) + metrics->num_res;
+}
+
+size_t metrics_size(int num_res);
+void metrics_init(struct oss_metrics* metrics, int num_res);
+void metrics_begin(struct oss_metrics* metrics);
+void metrics_end(struct oss_metrics* metrics);
+void metrics_stop(struct oss_metrics* metrics);
+bool metrics_read(const struct oss_metrics* metrics, struct oss_metrics* copy, int16_t* allocated, int16_t* total);
+
+#endif
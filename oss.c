@@ -7,38 +7,141 @@
 #include <errno.h>
 #include <wait.h>
 #include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <sys/resource.h>
 
 #include "shared.h"
 #include "config.h"
-#include "queue.h"
-
-static pid_t children[MAX_PROCESSES];
+#include "sched.h"
+#include "waitlist.h"
+#include "banker.h"
+#include "logger.h"
+#include "event.h"
+#include "dispatcher.h"
+#include "histogram.h"
+#include "trace.h"
+#include "shard.h"
+#include "watch.h"
+
+enum Deadlock_Modes {MODE_AVOID, MODE_DETECT};
+enum Latency_Metrics {LAT_REQUEST_GRANT, LAT_BLOCKED, LAT_DISPATCH, LAT_IS_SAFE, LAT_METRICS};
+
+static pid_t* children;
+static pid_t* workers;
+static bool pool_mode = false;
 static size_t num_children = 0;
 extern struct oss_shm* shared_mem;
-static struct Queue proc_queue;
-static struct Queue copy_queue;
+static char* sched_policy = "rr";
+static bool wait_queue = false;
+static bool blocking = false;
+static int deadlock_mode = MODE_AVOID;
+static int* rollbacks;
+// Slots dispatched but not finished, whose child exited meanwhile, and whose child died
+// without terminating. A child's exit is dealt with by whoever is serving its turn.
+static bool* in_turn;
+static bool* exited;
+static bool* lost;
+// Slots whose batch released resources, even if the batch ended some other way
+static bool* freed;
 static struct message msg;
+static int dispatch_threads = 0;
+static pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
 static char* exe_name;
-static int log_line = 0;
 static int total_procs = 0;
-static struct time_clock last_run;
+static struct event_queue events;
+static bool spawn_scheduled = false;
+static bool dispatch_scheduled = false;
+static struct oss_config config;
 
 struct statistics {
     unsigned int granted_requests;
     unsigned int denied_requests;
+    unsigned int parked_requests;
     unsigned int terminations;
     unsigned int releases;
+    unsigned int deadlocks;
+    unsigned int rollbacks;
+    unsigned int wakeups;
+    unsigned int forced_wakeups;
+    unsigned int lost;
+    unsigned int batches;
+    unsigned int batched_ops;
 };
 
 static struct statistics stats;
 
+// Latency histograms in simulated and wall clock nanoseconds
+static const char* latency_names[LAT_METRICS] = {"request_to_grant", "blocked", "dispatch_round_trip", "is_safe"};
+static struct histogram sim_latency[LAT_METRICS];
+static struct histogram wall_latency[LAT_METRICS];
+
+// When each process's outstanding request arrived and when it last blocked, in both clocks
+struct proc_times {
+    uint64_t request_sim;
+    uint64_t request_wall;
+    uint64_t blocked_sim;
+    uint64_t blocked_wall;
+};
+
+static struct proc_times* times;
+static volatile sig_atomic_t export_requested = 0;
+static volatile sig_atomic_t stop_signal = 0;
+static uint64_t seed = 0;
+static bool seeded = false;
+static char* trace_path = NULL;
+static char* replay_path = NULL;
+static long bench_rounds = 0;
+static struct histogram bench_latency;
+
+static const struct option long_options[] = {
+    {"seed", required_argument, NULL, 'S'},
+    {"trace", required_argument, NULL, 'T'},
+    {"replay", required_argument, NULL, 'R'},
+    {"bench-ipc", required_argument, NULL, 'B'},
+    {NULL, 0, NULL, 0}
+};
+
 void help();
 void signal_handler(int signum);
+void export_handler(int signum);
+void shutdown_oss(int signum);
+uint64_t wall_now();
+void record_latency(int metric, uint64_t sim_start, uint64_t wall_start);
+void mark_blocked(int sim_pid);
+void record_woken(int* sim_pids, int count);
+void export_stats(const char* path);
+void publish_metrics();
+void replay_trace(const char* path);
+void bench_ipc(long rounds);
 void initialize();
-int launch_child();
-void try_spawn_child();
-bool is_safe(int sim_pid, int resources[MAX_RES_INSTANCES]);
+int launch_child(int sim_pid);
+bool try_spawn_child();
+void schedule_spawn();
+void schedule_dispatch(uint64_t delay);
+void reap_child(int sim_pid);
+void lose_child(int sim_pid);
+void poll_watch(int timeout_ms);
+bool start_worker(int sim_pid);
+void start_workers();
+void stop_workers();
+void log_snapshot();
+bool is_safe(int sim_pid, int* resources);
+bool shard_is_safe(int sim_pid, int* requests);
 void handle_processes();
+int serve_process(int sim_pid);
+int serve_op(int sim_pid, int opcode, const int16_t* vector, int* reply);
+int serve_batch(int sim_pid, struct message* batch);
+void terminate_process(int sim_pid);
+void finish_turn(int sim_pid, int outcome);
+void dispatch_process();
+void collect_turns(bool wait);
+void wake_blocked();
+void grant_parked();
+bool can_grant(int sim_pid, int* requests);
+void detect_deadlock();
+void mark_freed(int sim_pid);
 void remove_child(pid_t pid);
 void matrix_to_string(char* buffer, size_t buffer_size, int* matrix, int rows, int cols);
 void output_stats();
@@ -46,55 +149,234 @@ void save_to_log(char* text);
 
 int main(int argc, char** argv) {
     int option;
+    int transport = TRANSPORT_MSGQ;
+    bool log_nonblocking = false;
     exe_name = argv[0];
+    config_defaults(&config);
 
     // Process arguments
-    while ((option = getopt(argc, argv, "h")) != -1) {
+    while ((option = getopt_long(argc, argv, "B:bd:hf:Lm:o:Ps:t:wS:T:R:", long_options, NULL)) != -1) {
         switch (option) {
+            case 'B':
+                bench_rounds = atol(optarg);
+                if (bench_rounds < 1) {
+                    fprintf(stderr, "%s: benchmark needs at least one round trip\n", exe_name);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'b':
+                blocking = true;
+                break;
             case 'h':
                 help();
                 exit(EXIT_SUCCESS);
+            case 'd':
+                dispatch_threads = atoi(optarg);
+                if (dispatch_threads < 0) {
+                    fprintf(stderr, "%s: dispatcher threads must not be negative\n", exe_name);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'f':
+                if (!config_load(&config, optarg)) exit(EXIT_FAILURE);
+                break;
+            case 'o':
+                if (!config_parse(&config, optarg)) exit(EXIT_FAILURE);
+                break;
+            case 'L':
+                log_nonblocking = true;
+                break;
+            case 'm':
+                if (strcmp(optarg, "avoid") == 0) {
+                    deadlock_mode = MODE_AVOID;
+                }
+                else if (strcmp(optarg, "detect") == 0) {
+                    // Requests that do not fit have to wait somewhere, so detection implies -b
+                    deadlock_mode = MODE_DETECT;
+                    blocking = true;
+                }
+                else {
+                    fprintf(stderr, "%s: unknown deadlock mode '%s'\n", exe_name, optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'P':
+                pool_mode = true;
+                break;
+            case 's':
+                sched_policy = optarg;
+                break;
+            case 't':
+                if (strcmp(optarg, "msgq") == 0) {
+                    transport = TRANSPORT_MSGQ;
+                }
+                else if (strcmp(optarg, "ring") == 0) {
+                    transport = TRANSPORT_RING;
+                }
+                else {
+                    fprintf(stderr, "%s: unknown transport '%s'\n", exe_name, optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'w':
+                wait_queue = true;
+                break;
+            case 'S':
+                seed = strtoull(optarg, NULL, 0);
+                seeded = true;
+                break;
+            case 'T':
+                trace_path = optarg;
+                break;
+            case 'R':
+                replay_path = optarg;
+                break;
             case '?':
                 // Getopt handles error messages
                 exit(EXIT_FAILURE);
         }
     }
+    if (!config_validate(&config)) exit(EXIT_FAILURE);
+    // Shards only guarantee each partition is safe, so a request must never wait while holding
+    // part of a cross-shard claim. Parked requests could, so sharding only supports plain avoid mode.
+    if (config.shards > 0 && (deadlock_mode == MODE_DETECT || blocking)) {
+        fprintf(stderr, "%s: shards only decide requests in avoid mode without -b\n", exe_name);
+        exit(EXIT_FAILURE);
+    }
 
-    // Clear logfile
-    FILE* file_ptr = fopen(LOG_FILE, "w");
-    fclose(file_ptr);
+    // Replays drive the allocator straight from a trace, with no children or IPC
+    if (replay_path != NULL) {
+        replay_trace(replay_path);
+        exit(EXIT_SUCCESS);
+    }
+
+    if (!sched_init(sched_policy, config.processes, config.resources, wait_queue)) {
+        fprintf(stderr, "%s: unknown scheduling policy '%s'\n", exe_name, sched_policy);
+        exit(EXIT_FAILURE);
+    }
+
+    // Clear logfile and start the log writer
+    log_open(LOG_FILE, log_nonblocking);
 
 
     // Initialize
     initialize();
+    shared_mem->transport = transport;
+
+    // The IPC benchmark only needs children and the transport, not the simulation
+    if (bench_rounds > 0) {
+        bench_ipc(bench_rounds);
+        if (stop_signal) shutdown_oss(stop_signal);
+        sched_free();
+        log_close();
+        watch_close();
+        dest_oss();
+        exit(EXIT_SUCCESS);
+    }
+    if (trace_path != NULL) {
+        int16_t totals[config.resources];
+        int16_t shared[config.resources];
+        for (int i = 0; i < config.resources; i++) {
+            totals[i] = shm_descr(shared_mem, i)->resource;
+            shared[i] = shm_descr(shared_mem, i)->is_shared;
+        }
+        if (!trace_open(trace_path, config.processes, config.resources, seed, totals, shared)) exit(EXIT_FAILURE);
+    }
+    if (config.shards > 0 && !shard_start(shared_mem)) {
+        shard_kill();
+        dest_oss();
+        exit(EXIT_FAILURE);
+    }
+    if (pool_mode) start_workers();
+    if (dispatch_threads > 0) {
+        dispatcher_start(dispatch_threads, config.processes, serve_process);
+        dispatcher_notify(watch_turn_fd());
+    }
 
-    // Keep track of the last time on the sys clock when we run a process
-    last_run.nanoseconds = 0;
-    last_run.seconds = 0;
+    // Seed the simulation with the first spawn and stats snapshot
+    event_queue_init(&events);
+    schedule_spawn();
+    event_push(&events, clock_now(&shared_mem->sys_clock) + config.stats_secs * NS_PER_SEC, EVENT_STATS, 0);
+    if (deadlock_mode == MODE_DETECT) {
+        event_push(&events, clock_now(&shared_mem->sys_clock) + config.detect_secs * NS_PER_SEC, EVENT_DETECT, 0);
+    }
 
-    // Main OSS loop. We handle scheduling processes here.
+    // Main OSS loop. Run events in time order, jumping the clock straight to each one.
+    struct event event;
     while (true) {
-        // Simulate some passed time for this loop (1 second and [0, 1000] nanoseconds)
-        add_time(&(shared_mem->sys_clock), 1, rand() % 1000);
-        // try to spawn a new child if enough time has passed
-        try_spawn_child();
-
-        // Handle process requests 
-        handle_processes();
-
-        // See if any child processes have terminated
-        pid_t pid = waitpid(-1, NULL, WNOHANG);
-		if (pid > 0) {
-            // Clear up this process for future use
-            remove_child(pid);
-		}
+        // SIGINT or SIGALRM only flag the stop, so it happens here where no lock is held
+        if (stop_signal) shutdown_oss(stop_signal);
+
+        // Pick up finished dispatcher turns. Wait on them if there are no events left, or if
+        // nothing is ready to dispatch, so the clock does not run ahead of turns in flight.
+        if (dispatch_threads > 0) {
+            collect_turns(event_queue_is_empty(&events) || (!dispatch_scheduled && dispatcher_in_flight() > 0));
+        }
+
+        // React to child exits and the metrics timer without waiting
+        poll_watch(0);
+
+        // Write the statistics out if SIGUSR1 asked for them
+        if (export_requested) {
+            export_requested = 0;
+            export_stats(STATS_JSON_FILE);
+        }
 
         // If we've run all the processes we need and have no more children we can exit
-        if (total_procs > MAX_RUN_PROCS && queue_is_empty(&proc_queue)) {
+        if (total_procs > config.run_procs && sched_ready() == 0 && sched_blocked() == 0 && num_children == 0) {
             break;
         } 
+
+        if (!event_pop(&events, &event)) break;
+        if (event.time > clock_now(&shared_mem->sys_clock)) {
+            clock_set(&shared_mem->sys_clock, event.time);
+        }
+
+        switch (event.type) {
+            case EVENT_SPAWN:
+                spawn_scheduled = false;
+                // If the table is full the next spawn is scheduled when a child exits
+                if (try_spawn_child()) {
+                    schedule_dispatch(0);
+                    schedule_spawn();
+                }
+                break;
+            case EVENT_DISPATCH:
+                dispatch_scheduled = false;
+                // Handle process requests, inline or on a dispatcher thread
+                if (dispatch_threads > 0) dispatch_process();
+                else handle_processes();
+                // Each scheduling turn takes 1 second and [0, 1000] nanoseconds of simulated time
+                schedule_dispatch(NS_PER_SEC + rand() % 1000);
+                break;
+            case EVENT_CHILD_EXIT:
+                // Clear up this process for future use
+                reap_child(event.arg);
+                schedule_spawn();
+                break;
+            case EVENT_STATS:
+                log_snapshot();
+                event_push(&events, clock_now(&shared_mem->sys_clock) + config.stats_secs * NS_PER_SEC, EVENT_STATS, 0);
+                break;
+            case EVENT_DETECT:
+                detect_deadlock();
+                event_push(&events, clock_now(&shared_mem->sys_clock) + config.detect_secs * NS_PER_SEC, EVENT_DETECT, 0);
+                break;
+        }
     }
+    event_queue_free(&events);
+    if (dispatch_threads > 0) dispatcher_stop();
+    if (pool_mode) stop_workers();
+    if (config.shards > 0) shard_stop();
     output_stats();
+    export_stats(STATS_JSON_FILE);
+    publish_metrics();
+    metrics_stop(shm_metrics(shared_mem));
+    trace_close();
+    sched_free();
+    waitlist_free();
+    log_close();
+    watch_close();
     dest_oss();
     exit(EXIT_SUCCESS);
 }
@@ -103,73 +385,254 @@ void help() {
     printf("Operating System Simulator usage\n");
 	printf("\n");
 	printf("[-h]\tShow this help dialogue.\n");
+	printf("[-f file]\tRead \"key = value\" settings from file.\n");
+	printf("[-o key=value]\tSet one setting. Applied in order with -f, so later ones win.\n");
+	printf("\tKeys: processes, resources, run_procs, runtime,\n");
+	printf("\t      min_spawn_secs, max_spawn_secs, min_spawn_ns, max_spawn_ns, stats_secs, detect_secs,\n");
+	printf("\t      request_dist (uniform, zipf or bursty), shards, shared_pct,\n");
+	printf("\t      batch (operations per scheduling turn, default 1)\n");
+	printf("[-d threads]\tServe scheduling turns on this many dispatcher threads (default 0, inline).\n");
+	printf("[-P]\tPre-fork one user_proc worker per slot and reuse it instead of fork+exec per process.\n");
+	printf("[-L]\tDrop log lines instead of waiting when the log buffer is full.\n");
+	printf("[-s policy]\tScheduling policy: rr (round robin, default) or mlfq (multi-level feedback).\n");
+	printf("[-m mode]\tDeadlock handling: avoid (Banker's check per request, default) or detect\n");
+	printf("\t(grant whatever fits, detect deadlock every detect_secs and roll back victims; implies -b).\n");
+	printf("[-b]\tPark unsafe requests on per-resource wait lists and grant them once releases make them safe.\n");
+	printf("[-w]\tPark denied processes until a release or termination frees what they asked for.\n");
+	printf("[-S, --seed n]\tSeed every random choice so runs repeat exactly (inline dispatch only).\n");
+	printf("[-T, --trace file]\tRecord every admit, request, grant, release and terminate to a binary trace.\n");
+	printf("[-R, --replay file]\tFeed a recorded trace through the allocator without forking children.\n");
+	printf("[-B, --bench-ipc rounds]\tTime this many dispatch round trips against echo children and exit.\n");
+	printf("[-t transport]\tOSS<->user_proc transport: msgq (default) or ring.\n");
 	printf("\n");
 }
 
+// SIGINT and SIGALRM ask oss to stop. The main loop shuts down outside the handler,
+// as the shutdown takes the log, trace and stdio locks.
 void signal_handler(int signum) {
+    stop_signal = signum;
+}
+
+// Kill the children, write out the statistics and clean up after a stop signal
+void shutdown_oss(int signum) {
     // Issue messages
 	if (signum == SIGINT) {
 		fprintf(stderr, "\nRecieved SIGINT signal interrupt, terminating children.\n");
 	}
 	else if (signum == SIGALRM) {
-		fprintf(stderr, "\nProcess execution timeout. Failed to finish in %d seconds.\n", MAX_RUNTIME);
+		fprintf(stderr, "\nProcess execution timeout. Failed to finish in %d seconds.\n", config.runtime);
 	}
 
-    // Kill active children
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (children[i] > 0) {
+    // Kill active children and wait on them
+    for (int i = 0; i < config.processes; i++) {
+        if (children[i] > 0 && !pool_mode) {
             kill(children[i], SIGKILL);
+            waitpid(children[i], NULL, 0);
+        }
+        if (children[i] > 0) {
             children[i] = 0;
             num_children--;
         }
+        if ((pool_mode || bench_rounds > 0) && workers[i] > 0) {
+            kill(workers[i], SIGKILL);
+            waitpid(workers[i], NULL, 0);
+            workers[i] = 0;
+        }
     }
 
+    if (config.shards > 0) shard_kill();
+    // Turns in flight see their child exit, so the dispatcher threads finish them and stop
+    if (dispatch_threads > 0 && bench_rounds == 0) dispatcher_stop();
+
     output_stats();
+    export_stats(STATS_JSON_FILE);
+    publish_metrics();
+    metrics_stop(shm_metrics(shared_mem));
+    trace_close();
+    log_close();
+    watch_close();
 
     // Cleanup oss shared memory
     dest_oss();
+    exit(EXIT_SUCCESS);
+}
 
-    if (signum == SIGINT) exit(EXIT_SUCCESS);
-	if (signum == SIGALRM) exit(EXIT_SUCCESS);
+// SIGUSR1 asks for a JSON export. The main loop writes it outside the handler.
+void export_handler(int signum) {
+    export_requested = 1;
 }
 
-void initialize() {
-    // Initialize random number gen
-    srand((int)time(NULL) + getpid());
+uint64_t wall_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
 
-    // Attach to and initialize shared memory.
-    init_oss(true);
+// Record the time since sim_start and wall_start for metric in both clocks
+void record_latency(int metric, uint64_t sim_start, uint64_t wall_start) {
+    hist_record(&sim_latency[metric], clock_now(&shared_mem->sys_clock) - sim_start);
+    hist_record(&wall_latency[metric], wall_now() - wall_start);
+}
 
-    // initialize process queue
-    queue_init(&proc_queue);
+// Write counters, throughput and latency percentiles as JSON. Written to a temporary
+// file and renamed so a reader never sees a partial export.
+void export_stats(const char* path) {
+    char tmp_path[256];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        perror("Could not write stats export");
+        return;
+    }
+
+    uint64_t sim_ns = clock_now(&shared_mem->sys_clock);
+    double sim_secs = sim_ns > 0 ? (double)sim_ns / NS_PER_SEC : 1.0;
+    fprintf(file, "{\n  \"sim_time_ns\": %lu,\n", (unsigned long)sim_ns);
+    fprintf(file, "  \"counters\": {\"granted\": %u, \"denied\": %u, \"parked\": %u, \"terminations\": %u, \"releases\": %u, \"deadlocks\": %u, \"rollbacks\": %u, \"lost\": %u, \"batches\": %u, \"batched_ops\": %u},\n",
+        stats.granted_requests, stats.denied_requests, stats.parked_requests, stats.terminations, stats.releases, stats.deadlocks, stats.rollbacks, stats.lost,
+        stats.batches, stats.batched_ops);
+    fprintf(file, "  \"throughput_per_sim_sec\": {\"requests\": %.4f, \"grants\": %.4f, \"releases\": %.4f, \"terminations\": %.4f},\n",
+        (stats.granted_requests + stats.denied_requests) / sim_secs, stats.granted_requests / sim_secs,
+        stats.releases / sim_secs, stats.terminations / sim_secs);
+    fprintf(file, "  \"latency_ns\": {\n");
+    for (int i = 0; i < LAT_METRICS; i++) {
+        fprintf(file, "    \"%s\": {\"sim\": ", latency_names[i]);
+        hist_json(file, &sim_latency[i]);
+        fprintf(file, ", \"wall\": ");
+        hist_json(file, &wall_latency[i]);
+        fprintf(file, "}%s\n", i < LAT_METRICS - 1 ? "," : "");
+    }
+    fprintf(file, "  }\n}\n");
+    fclose(file);
+
+    if (rename(tmp_path, path) < 0) perror("Could not write stats export");
+}
+
+// Copy counters, queue depths and resource use into the shared metrics page
+void publish_metrics() {
+    struct oss_metrics* metrics = shm_metrics(shared_mem);
+    struct banker_state* banker = shm_banker(shared_mem);
+    int16_t* allocated = metrics_allocated(metrics);
+    int16_t* total = metrics_total(metrics);
+
+    metrics_begin(metrics);
+    metrics->sim_time_ns = clock_now(&shared_mem->sys_clock);
+    metrics->wall_time_ns = wall_now();
+    metrics->granted = stats.granted_requests;
+    metrics->denied = stats.denied_requests;
+    metrics->parked = stats.parked_requests;
+    metrics->terminations = stats.terminations;
+    metrics->releases = stats.releases;
+    metrics->deadlocks = stats.deadlocks;
+    metrics->rollbacks = stats.rollbacks;
+    metrics->ready = sched_ready();
+    metrics->blocked = sched_blocked();
+    metrics->waiting = waitlist_parked();
+    metrics->children = num_children;
+    metrics->total_procs = total_procs;
+    int shared[config.resources];
+    int num_shared = 0;
+    pthread_mutex_lock(&alloc_lock);
+    for (int i = 0; i < config.resources; i++) {
+        total[i] = shm_descr(shared_mem, i)->resource;
+        if (shm_descr(shared_mem, i)->is_shared) {
+            shared[num_shared++] = i;
+            allocated[i] = 0;
+        }
+        else {
+            allocated[i] = total[i] - banker_available(banker)[i];
+        }
+    }
+    // Shared resources never leave available. Their holders share the same instances,
+    // so what is in use is the largest hold of any live process.
+    for (int p = 0; p < config.processes && num_shared > 0; p++) {
+        if (children[p] <= 0) continue;
+        const int16_t* allow_res = pcb_allow_res(shared_mem, p);
+        for (int s = 0; s < num_shared; s++) {
+            int i = shared[s];
+            if (allow_res[i] > allocated[i]) allocated[i] = allow_res[i];
+        }
+    }
+    pthread_mutex_unlock(&alloc_lock);
+    metrics_end(metrics);
+}
+
+void initialize() {
+    // Initialize random number gen
+    if (seeded) srand((unsigned int)(seed ^ (seed >> 32)));
+    else srand((int)time(NULL) + getpid());
+
+    // Attach to and initialize shared memory sized from config.
+    init_oss(true, &config);
+    shared_mem->seed = seed;
+    shared_mem->seeded = seeded;
+
+    // Per-resource wait lists for parked requests
+    if (blocking && !waitlist_init(config.processes, config.resources)) {
+        perror("Could not allocate wait lists");
+        exit(EXIT_FAILURE);
+    }
 
     // Initialize children array
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        children[i] = 0;
+    children = calloc(config.processes, sizeof(pid_t));
+    workers = calloc(config.processes, sizeof(pid_t));
+    rollbacks = calloc(config.processes, sizeof(int));
+    in_turn = calloc(config.processes, sizeof(bool));
+    exited = calloc(config.processes, sizeof(bool));
+    lost = calloc(config.processes, sizeof(bool));
+    freed = calloc(config.processes, sizeof(bool));
+    times = calloc(config.processes, sizeof(struct proc_times));
+    for (int i = 0; i < LAT_METRICS; i++) {
+        hist_init(&sim_latency[i]);
+        hist_init(&wall_latency[i]);
     }
 
     // init stats
     stats.granted_requests = 0;
     stats.denied_requests = 0;
+    stats.parked_requests = 0;
     stats.releases = 0;
     stats.terminations = 0;
+    stats.deadlocks = 0;
+    stats.rollbacks = 0;
+    stats.wakeups = 0;
+    stats.forced_wakeups = 0;
+    stats.lost = 0;
+    stats.batches = 0;
+    stats.batched_ops = 0;
+
+    // Child exits, finished turns and the metrics timer all arrive through one epoll set
+    if (!watch_init(config.processes, METRICS_PUBLISH_NS)) {
+        dest_oss();
+        exit(EXIT_FAILURE);
+    }
+    watch_stop_on(&stop_signal);
 
     // Setup signal handlers
 	signal(SIGINT, signal_handler);
 	signal(SIGALRM, signal_handler);
+	signal(SIGUSR1, export_handler);
 
-	// Terminate in MAX_RUNTIME	
-	alarm(MAX_RUNTIME);
+	// Terminate in config.runtime seconds
+	alarm(config.runtime);
 }
 
-int launch_child() {
+int launch_child(int sim_pid) {
     char* program = "./user_proc";
-    return execl(program, program, NULL);
+    char pid_arg[16], doorbell_arg[16];
+    snprintf(pid_arg, sizeof(pid_arg), "%d", sim_pid);
+    // Keep only this slot's doorbell open across exec
+    int doorbell = watch_doorbell(sim_pid);
+    fcntl(doorbell, F_SETFD, 0);
+    snprintf(doorbell_arg, sizeof(doorbell_arg), "%d", doorbell);
+    if (bench_rounds > 0) return execl(program, program, "-p", pid_arg, "-D", doorbell_arg, "-e", NULL);
+    if (pool_mode) return execl(program, program, "-p", pid_arg, "-D", doorbell_arg, "-w", NULL);
+    return execl(program, program, "-p", pid_arg, "-D", doorbell_arg, NULL);
 }
 
 void remove_child(pid_t pid) {
 	// Remove pid from children list (slow linear search - but small list so inconsequential)
-    for (int i = 0; i < num_children; i++) {
+    for (int i = 0; i < config.processes; i++) {
 		if (children[i] == pid) {
 			// If match, set pid to 0
 			children[i] = 0;
@@ -179,286 +642,777 @@ void remove_child(pid_t pid) {
 	}
 }
 
-void try_spawn_child() {
-    if (total_procs > MAX_RUN_PROCS) return;
-    // Check if enough time has passed on simulated sys clock to spawn new child
+// Schedule the next spawn a random interval from now unless one is pending or we are done
+void schedule_spawn() {
+    if (spawn_scheduled || total_procs > config.run_procs) return;
     // Time needed is calculated randomly to give some random offset between processes
-    int seconds = (rand() % (maxTimeBetweenNewProcsSecs + 1)) + minTimeBetweenNewProcsSecs;
-    int nansecs = (rand() % (maxTimeBetweenNewProcsNS + 1)) + minTimeBetweenNewProcsNS;
-    if ((shared_mem->sys_clock.seconds - last_run.seconds > seconds) && 
-    (shared_mem->sys_clock.nanoseconds - last_run.nanoseconds > nansecs)) {
-        // Check process control block availablity
-        if (num_children < MAX_PROCESSES) {
-            // Find open slot to put pid
-            int sim_pid;
-            for (sim_pid = 0; sim_pid < MAX_PROCESSES; sim_pid++) {
-                if (children[sim_pid] == 0) break;
-            }
+    unsigned long seconds = config.min_spawn_secs + rand() % (config.max_spawn_secs - config.min_spawn_secs + 1);
+    unsigned long nansecs = config.min_spawn_ns + rand() % (config.max_spawn_ns - config.min_spawn_ns + 1);
+    event_push(&events, clock_now(&shared_mem->sys_clock) + seconds * NS_PER_SEC + nansecs, EVENT_SPAWN, 0);
+    spawn_scheduled = true;
+}
 
-            // Add to process table
-            shared_mem->process_table[sim_pid].sim_pid = sim_pid;
-            // initalize maxium and allocated resources for this process
-            for (int i = 0; i < MAX_RES_INSTANCES; i++) {
-                // Random maxium resources this process will use from any given resource descriptor
-                shared_mem->process_table[sim_pid].max_res[i] = rand() % (shared_mem->descriptors[i].resource + 1);
-                shared_mem->process_table[sim_pid].allow_res[i] = 0;
-            }
+// Schedule the next scheduling turn delay nanoseconds from now if anything is ready
+void schedule_dispatch(uint64_t delay) {
+    if (dispatch_scheduled) return;
+    // With nothing ready or running, nothing will free resources, so re-check every parked request
+    if (sched_ready() == 0 && blocking && waitlist_parked() > 0 && (dispatch_threads == 0 || dispatcher_in_flight() == 0)) {
+        waitlist_freed_all();
+        grant_parked();
+    }
+    // With nothing ready or running, nobody can release what blocked processes wait on, so let them retry
+    if (sched_ready() == 0 && sched_blocked() > 0 && (dispatch_threads == 0 || dispatcher_in_flight() == 0)) {
+        int woken[config.processes];
+        int count = sched_wake_all(woken);
+        stats.forced_wakeups += count;
+        record_woken(woken, count);
+    }
+    if (sched_ready() == 0) return;
+    event_push(&events, clock_now(&shared_mem->sys_clock) + delay, EVENT_DISPATCH, 0);
+    dispatch_scheduled = true;
+}
 
-            // Fork and launch child process
-            pid_t pid = fork();
-            if (pid == 0) {
-                if (launch_child() < 0) {
-                    printf("Failed to launch process.\n");
-                    exit(EXIT_FAILURE);
-                }
-            } 
-            else {
-                // keep track of child's real pid
-                children[sim_pid] = pid;
-                num_children++;
-                // add to queue
-                queue_insert(&proc_queue, sim_pid);
-                shared_mem->process_table[sim_pid].actual_pid = pid;
-                total_procs++;
-            }
-            // Add some time for generating a process (0.1ms)
-            add_time(&shared_mem->sys_clock, 0, rand() % 100000);
-            // Update last run
-            add_time(&last_run, shared_mem->sys_clock.seconds, shared_mem->sys_clock.nanoseconds);
+// Fork the pool worker for a process table slot. It waits for a reset before running.
+// Returns false if the fork failed.
+bool start_worker(int sim_pid) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (launch_child(sim_pid) < 0) {
+            printf("Failed to launch process.\n");
+            exit(EXIT_FAILURE);
         }
     }
+    else if (pid < 0) {
+        // Leave no stale pid behind, so the slot is known to have no worker
+        perror("Could not fork pool worker");
+        workers[sim_pid] = 0;
+        return false;
+    }
+    workers[sim_pid] = pid;
+    watch_child(sim_pid, pid);
+    return true;
 }
 
-// Handle children processes requests over message queues
-void handle_processes() {
+// Fork one pool worker per process table slot
+void start_workers() {
+    for (int sim_pid = 0; sim_pid < config.processes; sim_pid++) {
+        start_worker(sim_pid);
+    }
+}
+
+// Tell every idle pool worker to exit and wait for them
+void stop_workers() {
+    for (int sim_pid = 0; sim_pid < config.processes; sim_pid++) {
+        if (workers[sim_pid] <= 0) continue;
+        watch_forget(sim_pid);
+        msg_init(&msg, workers[sim_pid], MSG_EXIT, sim_pid);
+        send_msg(&msg, PROC_MSG, false);
+        waitpid(workers[sim_pid], NULL, 0);
+        workers[sim_pid] = 0;
+    }
+}
+
+// Wait on a child that has told us it is terminating, or that we lost, and free its slot
+void reap_child(int sim_pid) {
+    pid_t pid = children[sim_pid];
+    if (pid <= 0) return;
+    if (lost[sim_pid]) {
+        // Drop whatever we sent it that it never read
+        struct message stale;
+        msg_init(&stale, pid, MSG_RUN, sim_pid);
+        while (recieve_msg(&stale, PROC_MSG, false));
+    }
+    // Pool workers go back to waiting for a reset instead of exiting, unless they died
+    if (pool_mode && !lost[sim_pid]) {
+        remove_child(pid);
+        return;
+    }
+    if (waitpid(pid, NULL, 0) < 0) {
+        perror("Could not wait on child");
+    }
+    remove_child(pid);
+    if (pool_mode) start_worker(sim_pid);
+    lost[sim_pid] = false;
+}
+
+// Clean up after a child that exited outside its turn without terminating, e.g. it was
+// killed. What it held is given back and its slot is freed as if it had terminated.
+void lose_child(int sim_pid) {
     char log_buf[100];
-    // Return if no process in queue
-    int sim_pid = queue_peek(&proc_queue);
-    if (sim_pid < 0) return;
+    watch_forget(sim_pid);
+    // An idle pool worker holds nothing and only needs replacing
+    if (children[sim_pid] <= 0) {
+        if (pool_mode && workers[sim_pid] > 0) {
+            waitpid(workers[sim_pid], NULL, 0);
+            start_worker(sim_pid);
+        }
+        return;
+    }
+    snprintf(log_buf, 100, "OSS lost P%d, it exited without terminating", sim_pid);
+    save_to_log(log_buf);
+    __atomic_add_fetch(&stats.lost, 1, __ATOMIC_RELAXED);
+    lost[sim_pid] = true;
+
+    sched_remove(sim_pid);
+    pthread_mutex_lock(&alloc_lock);
+    if (blocking && waitlist_is_parked(sim_pid)) waitlist_unpark(sim_pid);
+    pthread_mutex_unlock(&alloc_lock);
+    terminate_process(sim_pid);
+    event_push(&events, clock_now(&shared_mem->sys_clock), EVENT_CHILD_EXIT, sim_pid);
+    wake_blocked();
+    grant_parked();
+}
+
+// Handle whatever the event loop has ready, waiting up to timeout_ms (-1 for ever) for something
+void poll_watch(int timeout_ms) {
+    struct watch_event ready[16];
+    int count = watch_wait(ready, 16, timeout_ms);
+    for (int i = 0; i < count; i++) {
+        switch (ready[i].kind) {
+            case WATCH_EXIT:
+                // A dispatcher thread serving it sees the exit itself. Check once the turn is back.
+                if (in_turn[ready[i].sim_pid]) exited[ready[i].sim_pid] = true;
+                else lose_child(ready[i].sim_pid);
+                break;
+            case WATCH_TIMER:
+                // Keep the shared metrics page fresh for monitors like oss_top
+                publish_metrics();
+                break;
+            case WATCH_TURN:
+                // Finished turns are picked up by collect_turns
+                break;
+        }
+    }
+}
+
+// Log a snapshot of the statistics so far
+void log_snapshot() {
+    char log_buf[200];
+    uint64_t now = clock_now(&shared_mem->sys_clock);
+    snprintf(log_buf, 200, "OSS stats at %lu:%lu: %u granted, %u denied, %u parked, %u terminations, %u releases, %zu ready, %zu blocked",
+        (unsigned long)(now / NS_PER_SEC), (unsigned long)(now % NS_PER_SEC),
+        stats.granted_requests, stats.denied_requests, stats.parked_requests, stats.terminations, stats.releases, sched_ready(), sched_blocked());
+    save_to_log(log_buf);
+}
+
+// Spawn a new child into a free process table slot. Returns false if we could not.
+bool try_spawn_child() {
+    if (total_procs > config.run_procs) return false;
+    // Check process control block availablity
+    if (num_children >= config.processes) return false;
+    // Find open slot to put pid
+    int sim_pid;
+    for (sim_pid = 0; sim_pid < config.processes; sim_pid++) {
+        if (children[sim_pid] == 0) break;
+    }
+    // A pool slot whose worker could not be forked gets another try before anything is admitted
+    if (pool_mode && workers[sim_pid] <= 0 && !start_worker(sim_pid)) {
+        schedule_spawn();
+        return false;
+    }
+
+    // Add to process table
+    shm_pcb(shared_mem, sim_pid)->sim_pid = sim_pid;
+    rollbacks[sim_pid] = 0;
+    // initalize maxium resources for this process
+    int16_t* max_res = pcb_max_res(shared_mem, sim_pid);
+    int claim[config.resources];
+    for (int i = 0; i < config.resources; i++) {
+        // Random maxium resources this process will use from any given resource descriptor
+        claim[i] = rand() % (shm_descr(shared_mem, i)->resource + 1);
+        max_res[i] = claim[i];
+    }
+    // Clears allocated resources and sets need to maximum
+    pthread_mutex_lock(&alloc_lock);
+    banker_admit(shared_mem, sim_pid);
+    trace_event(clock_now(&shared_mem->sys_clock), TRACE_ADMIT, sim_pid, claim);
+    pthread_mutex_unlock(&alloc_lock);
+    if (config.shards > 0) shard_admit(sim_pid);
+
+    // The process times its life from here rather than from whenever it gets to run
+    shm_pcb(shared_mem, sim_pid)->spawn_ns = clock_now(&shared_mem->sys_clock);
+    shm_pcb(shared_mem, sim_pid)->spawn_seq = total_procs;
+
+    // Hand the slot's pool worker its new identity instead of forking
+    if (pool_mode) {
+        children[sim_pid] = workers[sim_pid];
+        num_children++;
+        sched_add(sim_pid);
+        shm_pcb(shared_mem, sim_pid)->actual_pid = workers[sim_pid];
+        total_procs++;
+        msg_init(&msg, workers[sim_pid], MSG_RESET, sim_pid);
+        send_msg(&msg, PROC_MSG, false);
+        // Add some time for resetting a process (0.01ms)
+        add_time(&shared_mem->sys_clock, 0, rand() % 10000);
+        return true;
+    }
+
+    // Empty this slot's ring channel before the new process uses it
+    ring_init(&shm_channel(shared_mem, sim_pid)->to_oss);
+    ring_init(&shm_channel(shared_mem, sim_pid)->to_proc);
+
+    // Fork and launch child process
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (launch_child(sim_pid) < 0) {
+            printf("Failed to launch process.\n");
+            exit(EXIT_FAILURE);
+        }
+    } 
+    else {
+        // keep track of child's real pid
+        children[sim_pid] = pid;
+        watch_child(sim_pid, pid);
+        num_children++;
+        // add to the ready queue
+        sched_add(sim_pid);
+        shm_pcb(shared_mem, sim_pid)->actual_pid = pid;
+        total_procs++;
+    }
+    // Add some time for generating a process (0.1ms)
+    add_time(&shared_mem->sys_clock, 0, rand() % 100000);
+    return true;
+}
+
+// Serve one scheduling turn for sim_pid over the message transport.
+// Safe to call from several dispatcher threads at once for different processes.
+int serve_process(int sim_pid) {
+    char log_buf[100];
+    uint64_t now;
+    struct message msg;
+    pid_t actual_pid = shm_pcb(shared_mem, sim_pid)->actual_pid;
+    int outcome = TURN_GRANTED;
+    uint64_t sim_start = clock_now(&shared_mem->sys_clock);
+    uint64_t wall_start = wall_now();
+
+    // Charge the run message up front. The child reads the clock once it has it,
+    // so the clock must not move again until it replies.
+    add_time(&shared_mem->sys_clock, 0, rand() % 10000);
+
     // Get message from queued process
-    strncpy(msg.msg_text, "run", MSG_BUFFER_LEN);
-    msg.msg_type = shared_mem->process_table[sim_pid].actual_pid;
+    msg_init(&msg, actual_pid, MSG_RUN, sim_pid);
     send_msg(&msg, PROC_MSG, false);
 
-    snprintf(log_buf, 100, "OSS sent run message to P%d at %ld:%ld", sim_pid, shared_mem->sys_clock.seconds, shared_mem->sys_clock.nanoseconds);
+    now = clock_now(&shared_mem->sys_clock);
+    snprintf(log_buf, 100, "OSS sent run message to P%d at %lu:%lu", sim_pid, (unsigned long)(now / NS_PER_SEC), (unsigned long)(now % NS_PER_SEC));
     save_to_log(log_buf);
-    add_time(&shared_mem->sys_clock, 0, rand() % 10000);
 
 
-    strncpy(msg.msg_text, "", MSG_BUFFER_LEN);
-    msg.msg_type = shared_mem->process_table[sim_pid].actual_pid;
-    recieve_msg(&msg, OSS_MSG, true);
+    msg_init(&msg, actual_pid, MSG_RUN, sim_pid);
+    if (!watch_reply(shared_mem, sim_pid, &msg)) {
+        // oss is stopping and the child has not answered. Nothing changed hands, so leave
+        // it for shutdown_oss to kill.
+        if (stop_signal) return TURN_DENIED;
+        // It died before answering. Clean up after it as if it had terminated.
+        snprintf(log_buf, 100, "OSS lost P%d, it exited before answering", sim_pid);
+        save_to_log(log_buf);
+        __atomic_add_fetch(&stats.lost, 1, __ATOMIC_RELAXED);
+        lost[sim_pid] = true;
+        msg.opcode = MSG_TERMINATE;
+    }
+    record_latency(LAT_DISPATCH, sim_start, wall_start);
 
     add_time(&shared_mem->sys_clock, 0, rand() % 10000);
-    char* cmd = strtok(msg.msg_text, " ");
 
-    // If request command
-    if (strncmp(cmd, "request", MSG_BUFFER_LEN) == 0) {
-        snprintf(log_buf, 100, "OSS recieved request from P%d for some resources at %ld:%ld", sim_pid, shared_mem->sys_clock.seconds, shared_mem->sys_clock.nanoseconds);
+    if (msg.opcode == MSG_BATCH) {
+        outcome = serve_batch(sim_pid, &msg);
+    }
+    else {
+        int reply;
+        outcome = serve_op(sim_pid, msg.opcode, msg.resources, &reply);
+        // A request is answered now unless it was parked, releases and terminations are not
+        if (reply == MSG_ACQUIRED || reply == MSG_DENIED) {
+            msg_init(&msg, actual_pid, reply, sim_pid);
+            send_msg(&msg, PROC_MSG, false);
+        }
+    }
+
+    // Add some time for handling a process (0.1ms)
+    add_time(&shared_mem->sys_clock, 0, rand() % 100000);
+    return outcome;
+}
+
+// Serve one operation sim_pid sent, on its own or as part of a batch. Sets reply to the
+// opcode that answers it (see struct message) and returns the turn outcome it amounts to.
+int serve_op(int sim_pid, int opcode, const int16_t* vector, int* reply) {
+    char log_buf[100];
+    uint64_t now;
+    int outcome = TURN_GRANTED;
+    *reply = opcode;
+
+    if (opcode == MSG_REQUEST) {
+        now = clock_now(&shared_mem->sys_clock);
+        times[sim_pid].request_sim = now;
+        times[sim_pid].request_wall = wall_now();
+        snprintf(log_buf, 100, "OSS recieved request from P%d for some resources at %lu:%lu", sim_pid, (unsigned long)(now / NS_PER_SEC), (unsigned long)(now % NS_PER_SEC));
         save_to_log(log_buf);
-        int resources[MAX_RES_INSTANCES];
+        int resources[config.resources];
         // Get all resources requested
-        for (int i = 0; i < MAX_RES_INSTANCES; i++) {
-            cmd = strtok(NULL, " ");
-            resources[i] = atoi(cmd);
+        for (int i = 0; i < config.resources; i++) {
+            resources[i] = vector[i];
         }
+        add_time(&shared_mem->sys_clock, 0, rand() % 10000);
 
-        // Update allocated 
-        for (int i = 0; i < MAX_RES_INSTANCES; i++) {
-            shared_mem->process_table->allow_res[i] = resources[i];
+        // Check and grant under one lock so concurrent requests are ordered. Shards order
+        // requests themselves, so with -o shards only the global bookkeeping takes the lock.
+        // The trace records the request and its decision under the lock too, in the order
+        // a replay has to apply them.
+        bool safe;
+        if (config.shards > 0) {
+            safe = shard_is_safe(sim_pid, resources);
+            pthread_mutex_lock(&alloc_lock);
         }
-        add_time(&shared_mem->sys_clock, 0, rand() % 10000);
+        else {
+            pthread_mutex_lock(&alloc_lock);
+            safe = can_grant(sim_pid, resources);
+        }
+        trace_event(now, TRACE_REQUEST, sim_pid, resources);
+        if (safe) {
+            // Update allocated
+            banker_grant(shared_mem, sim_pid, resources);
+            trace_event(clock_now(&shared_mem->sys_clock), TRACE_GRANT, sim_pid, NULL);
+        }
+        else if (blocking) {
+            // Hold the request until a release makes it safe. The process waits on its reply.
+            waitlist_park(sim_pid, resources);
+            trace_event(clock_now(&shared_mem->sys_clock), TRACE_PARK, sim_pid, NULL);
+        }
+        else {
+            trace_event(clock_now(&shared_mem->sys_clock), TRACE_DENY, sim_pid, NULL);
+        }
+        pthread_mutex_unlock(&alloc_lock);
 
         // If we are deadlock safe then we can move on
-        if (is_safe(sim_pid, resources)) {
+        if (safe) {
             snprintf(log_buf, 100, "\tSafe state, granting request");
             save_to_log(log_buf);
-            // Send acquired message
-            strncpy(msg.msg_text, "acquired", MSG_BUFFER_LEN);
-            msg.msg_type = shared_mem->process_table[sim_pid].actual_pid;
-            send_msg(&msg, PROC_MSG, false);
-            stats.granted_requests++;
+            *reply = MSG_ACQUIRED;
+            __atomic_add_fetch(&stats.granted_requests, 1, __ATOMIC_RELAXED);
+            record_latency(LAT_REQUEST_GRANT, times[sim_pid].request_sim, times[sim_pid].request_wall);
+            outcome = TURN_GRANTED;
+        }
+        else if (blocking) {
+            snprintf(log_buf, 100, "\tUnsafe state, parking request");
+            save_to_log(log_buf);
+            __atomic_add_fetch(&stats.parked_requests, 1, __ATOMIC_RELAXED);
+            *reply = MSG_PARKED;
+            outcome = TURN_PARKED;
         }
         else {
             snprintf(log_buf, 100, "\tUnsafe state, denying request");
             save_to_log(log_buf);
-            strncpy(msg.msg_text, "denied", MSG_BUFFER_LEN);
-            msg.msg_type = shared_mem->process_table[sim_pid].actual_pid;
-            send_msg(&msg, PROC_MSG, false);
-            stats.denied_requests++;
+            *reply = MSG_DENIED;
+            __atomic_add_fetch(&stats.denied_requests, 1, __ATOMIC_RELAXED);
+            // Remember what was denied so a blocked process is only woken once it could fit
+            sched_set_request(sim_pid, resources);
+            outcome = TURN_DENIED;
         }
     }
-    else if (strncmp(cmd, "release", MSG_BUFFER_LEN) == 0) {
-        snprintf(log_buf, 100, "OSS releasing resources for P%d at %ld:%ld", sim_pid, shared_mem->sys_clock.seconds, shared_mem->sys_clock.nanoseconds);
+    else if (opcode == MSG_RELEASE) {
+        now = clock_now(&shared_mem->sys_clock);
+        snprintf(log_buf, 100, "OSS releasing resources for P%d at %lu:%lu", sim_pid, (unsigned long)(now / NS_PER_SEC), (unsigned long)(now % NS_PER_SEC));
         save_to_log(log_buf);
         // Release any allocated resources this process has and reset its max resources
         int num_res = 0;
-        for (int i = 0; i < MAX_RES_INSTANCES; i++) {
-            if (shared_mem->process_table[sim_pid].allow_res[i] > 0) {
-                snprintf(log_buf, 100, "\tReleasing resource %d with %d instances", i, shared_mem->process_table[sim_pid].allow_res[i]);
+        int16_t* allow_res = pcb_allow_res(shared_mem, sim_pid);
+        for (int i = 0; i < config.resources; i++) {
+            if (allow_res[i] > 0) {
+                snprintf(log_buf, 100, "\tReleasing resource %d with %d instances", i, allow_res[i]);
                 save_to_log(log_buf);
-                shared_mem->process_table[sim_pid].allow_res[i] = 0;
                 num_res++;
                 add_time(&shared_mem->sys_clock, 0, rand() % 100);
             }
         }
-        stats.releases++;
+        pthread_mutex_lock(&alloc_lock);
+        mark_freed(sim_pid);
+        banker_release(shared_mem, sim_pid);
+        if (config.shards > 0) shard_release(sim_pid);
+        trace_event(clock_now(&shared_mem->sys_clock), TRACE_RELEASE, sim_pid, NULL);
+        pthread_mutex_unlock(&alloc_lock);
+        __atomic_add_fetch(&stats.releases, 1, __ATOMIC_RELAXED);
+        outcome = TURN_RELEASED;
+        *reply = MSG_RELEASE;
 
         // If we had no resources notify
         if (num_res <= 0) {
             save_to_log("\tNo resources to release");
         }
     }
-    else if (strncmp(cmd, "terminate", MSG_BUFFER_LEN) == 0) {
-        // Release any allocated resources this process has and reset its max resources
-        int num_res = 0;
-        for (int i = 0; i < MAX_RES_INSTANCES; i++) {
-            if (shared_mem->process_table[sim_pid].allow_res[i] > 0) {
-                snprintf(log_buf, 100, "\tReleasing resource %d with %d instances", i, shared_mem->process_table[sim_pid].allow_res[i]);
-                save_to_log(log_buf);
-                shared_mem->process_table[sim_pid].max_res[i] = 0;
-                shared_mem->process_table[sim_pid].allow_res[i] = 0;
-                num_res++;
-                add_time(&shared_mem->sys_clock, 0, rand() % 100);
-            }
-        }
-        stats.terminations++;
+    else if (opcode == MSG_TERMINATE) {
+        terminate_process(sim_pid);
+        outcome = TURN_TERMINATED;
+    }
+    return outcome;
+}
 
-        // If we had no resources notify
-        if (num_res <= 0) {
-            save_to_log("\tNo resources to release");
+// Serve a batch of operations in order and answer them with one results message. The batch
+// ends early at a termination or a parked request, and the operations after it are dropped.
+// The child knows how many were served from the results. The turn ends as its last operation did.
+int serve_batch(int sim_pid, struct message* batch) {
+    char log_buf[100];
+    struct message results;
+    int outcome = TURN_GRANTED;
+    int num_entries = batch->num_res < RESOURCES_LIMIT ? batch->num_res : RESOURCES_LIMIT;
+    int num_ops = batch->num_ops < num_entries ? batch->num_ops : num_entries;
+    const int16_t* vector = batch->resources + num_ops;
+    const int16_t* end = batch->resources + num_entries;
+
+    snprintf(log_buf, 100, "OSS recieved a batch of %d operations from P%d", num_ops, sim_pid);
+    save_to_log(log_buf);
+    msg_init(&results, shm_pcb(shared_mem, sim_pid)->actual_pid, MSG_RESULTS, sim_pid);
+    for (int i = 0; i < num_ops; i++) {
+        int opcode = batch->resources[i];
+        if (opcode == MSG_REQUEST && vector + config.resources > end) break;
+
+        int reply;
+        outcome = serve_op(sim_pid, opcode, vector, &reply);
+        if (opcode == MSG_REQUEST) vector += config.resources;
+        if (opcode == MSG_RELEASE) freed[sim_pid] = true;
+        results.resources[results.num_ops++] = reply;
+        if (outcome == TURN_TERMINATED || outcome == TURN_PARKED) break;
+    }
+    results.num_res = results.num_ops;
+    __atomic_add_fetch(&stats.batches, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats.batched_ops, results.num_ops, __ATOMIC_RELAXED);
+
+    // A terminating child has already gone
+    if (outcome != TURN_TERMINATED) send_msg(&results, PROC_MSG, false);
+    return outcome;
+}
+
+// Release any allocated resources sim_pid has and reset its max resources
+void terminate_process(int sim_pid) {
+    char log_buf[100];
+    int num_res = 0;
+    int16_t* allow_res = pcb_allow_res(shared_mem, sim_pid);
+    for (int i = 0; i < config.resources; i++) {
+        if (allow_res[i] > 0) {
+            snprintf(log_buf, 100, "\tReleasing resource %d with %d instances", i, allow_res[i]);
+            save_to_log(log_buf);
+            num_res++;
+            add_time(&shared_mem->sys_clock, 0, rand() % 100);
         }
+    }
+    pthread_mutex_lock(&alloc_lock);
+    mark_freed(sim_pid);
+    banker_remove(shared_mem, sim_pid);
+    if (config.shards > 0) shard_remove(sim_pid);
+    trace_event(clock_now(&shared_mem->sys_clock), TRACE_TERMINATE, sim_pid, NULL);
+    pthread_mutex_unlock(&alloc_lock);
+    __atomic_add_fetch(&stats.terminations, 1, __ATOMIC_RELAXED);
+
+    // If we had no resources notify
+    if (num_res <= 0) {
+        save_to_log("\tNo resources to release");
+    }
+}
 
-        // Add some time for handling a process (0.1ms)
-        add_time(&shared_mem->sys_clock, 0, rand() % 100000);
+// Hand a process back to the scheduler after its turn, or retire it if it terminated
+void finish_turn(int sim_pid, int outcome) {
+    in_turn[sim_pid] = false;
+    if (outcome == TURN_TERMINATED) {
+        // Do not requeue this process. Its slot is freed once it has exited.
+        if (!pool_mode || lost[sim_pid]) watch_forget(sim_pid);
+        exited[sim_pid] = false;
+        event_push(&events, clock_now(&shared_mem->sys_clock), EVENT_CHILD_EXIT, sim_pid);
+    }
+    if (outcome == TURN_PARKED || (outcome == TURN_DENIED && wait_queue)) mark_blocked(sim_pid);
+    if (outcome == TURN_PARKED) {
+        // Its request may be granted from here on. Re-check it if something was freed meanwhile.
+        pthread_mutex_lock(&alloc_lock);
+        waitlist_settle(sim_pid);
+        pthread_mutex_unlock(&alloc_lock);
+        grant_parked();
+    }
+    sched_finish(sim_pid, outcome);
 
-        // Do not requeue this process.
-        sim_pid = queue_pop(&proc_queue);
-        remove_child(shared_mem->process_table[sim_pid].actual_pid);
-        return;
+    // Only a release or termination frees resources, so only they can unblock anyone
+    if (outcome == TURN_RELEASED || outcome == TURN_TERMINATED || freed[sim_pid]) {
+        wake_blocked();
+        grant_parked();
     }
+    freed[sim_pid] = false;
 
-    // Re-queue this process
-    queue_pop(&proc_queue);
-    queue_insert(&proc_queue, sim_pid);
+    // It exited after answering, so nobody noticed during its turn
+    if (exited[sim_pid]) {
+        exited[sim_pid] = false;
+        lose_child(sim_pid);
+    }
+}
 
-    // Add some time for handling a process (0.1ms)
-    add_time(&shared_mem->sys_clock, 0, rand() % 100000);
+// Note which resources sim_pid is about to give back so only their wait lists are rescanned.
+// Called with alloc_lock held.
+void mark_freed(int sim_pid) {
+    if (!blocking) return;
+    int16_t* allow_res = pcb_allow_res(shared_mem, sim_pid);
+    for (int i = 0; i < config.resources; i++) {
+        if (allow_res[i] > 0) waitlist_freed(i);
+    }
 }
 
-bool is_safe(int sim_pid, int requests[MAX_RES_INSTANCES]) {
+// Re-check parked requests waiting on freed resources and grant the ones that are now safe.
+// The parked process is still waiting on its reply, so it needs no new message to continue.
+void grant_parked() {
+    if (!blocking || waitlist_parked() == 0) return;
     char log_buf[100];
-    snprintf(log_buf, 100, "OSS running deadlock detection at %ld:%ld", shared_mem->sys_clock.seconds, shared_mem->sys_clock.nanoseconds);
-    add_time(&shared_mem->sys_clock, 0, rand() % 1000000);
-    save_to_log(log_buf);
+    int sim_pids[config.processes];
+    int granted = 0;
+
+    pthread_mutex_lock(&alloc_lock);
+    int count = waitlist_collect(sim_pids);
+    for (int i = 0; i < count; i++) {
+        int sim_pid = sim_pids[i];
+        int* request = waitlist_request(sim_pid);
+        if (!can_grant(sim_pid, request)) continue;
+        banker_grant(shared_mem, sim_pid, request);
+        waitlist_unpark(sim_pid);
+        trace_event(clock_now(&shared_mem->sys_clock), TRACE_GRANT_PARKED, sim_pid, NULL);
+        sim_pids[granted++] = sim_pid;
+    }
+    pthread_mutex_unlock(&alloc_lock);
 
-    memcpy(&copy_queue, &proc_queue, sizeof(struct Queue));
-    int size = copy_queue.size;
-    int curr_elm = queue_pop(&copy_queue);
-    int maximum[size][MAX_RES_INSTANCES];
-    int allocated[size][MAX_RES_INSTANCES];
-    int need[size][MAX_RES_INSTANCES];
-    int available[MAX_RES_INSTANCES];
-    int num_avail = 0;
+    record_woken(sim_pids, granted);
+    for (int i = 0; i < granted; i++) {
+        int sim_pid = sim_pids[i];
+        record_latency(LAT_REQUEST_GRANT, times[sim_pid].request_sim, times[sim_pid].request_wall);
+        snprintf(log_buf, 100, "OSS granting parked request from P%d", sim_pid);
+        save_to_log(log_buf);
+        msg_init(&msg, shm_pcb(shared_mem, sim_pid)->actual_pid, MSG_ACQUIRED, sim_pid);
+        send_msg(&msg, PROC_MSG, false);
+        __atomic_add_fetch(&stats.granted_requests, 1, __ATOMIC_RELAXED);
+        sched_finish(sim_pid, TURN_GRANTED);
+    }
+}
+
+// Move blocked processes whose denied request now fits the available resources back to ready
+void wake_blocked() {
+    if (sched_blocked() == 0) return;
+    int woken[config.processes];
+    pthread_mutex_lock(&alloc_lock);
+    int count = sched_wake(banker_available(shm_banker(shared_mem)), woken);
+    pthread_mutex_unlock(&alloc_lock);
+    __atomic_add_fetch(&stats.wakeups, count, __ATOMIC_RELAXED);
+    record_woken(woken, count);
+}
 
-    // Copy over available non-shared resource data
-    for (int i = 0; i < MAX_RES_INSTANCES; i++) {
-        // if (shared_mem->descriptors[i].is_shared) continue;
-        available[i] = shared_mem->descriptors[i].resource;
-        num_avail++;
+// Note when a process stopped being schedulable, for the blocked time histogram
+void mark_blocked(int sim_pid) {
+    times[sim_pid].blocked_sim = clock_now(&shared_mem->sys_clock);
+    times[sim_pid].blocked_wall = wall_now();
+}
+
+// Record how long each of these processes was blocked before becoming ready again
+void record_woken(int* sim_pids, int count) {
+    for (int i = 0; i < count; i++) {
+        record_latency(LAT_BLOCKED, times[sim_pids[i]].blocked_sim, times[sim_pids[i]].blocked_wall);
     }
+}
 
-    // get all processes resource data into maximum and allocated matrixes
-    for (int i = 0; i < size; i++) {
+// Handle the next ready process's request inline over the message transport
+void handle_processes() {
+    // Return if no process is ready
+    int sim_pid = sched_next();
+    if (sim_pid < 0) return;
 
-        for (int j = 0; j < MAX_RES_INSTANCES; j++) {
-            maximum[i][j] = shared_mem->process_table[curr_elm].max_res[j];
-            allocated[i][j] = shared_mem->process_table[curr_elm].allow_res[j];
+    in_turn[sim_pid] = true;
+    finish_turn(sim_pid, serve_process(sim_pid));
+}
+
+// Hand the next ready process to a dispatcher thread, waiting for one to be free
+void dispatch_process() {
+    if (dispatcher_idle() == 0) collect_turns(true);
+    int sim_pid = sched_next();
+    if (sim_pid < 0) return;
+    in_turn[sim_pid] = true;
+    dispatcher_submit(sim_pid);
+}
+
+// Requeue or retire processes whose turns the dispatcher threads have finished.
+// While waiting for one, child exits and the metrics timer are still handled.
+void collect_turns(bool wait) {
+    struct dispatch_result result;
+    while (true) {
+        if (dispatcher_complete(&result, false)) {
+            finish_turn(result.sim_pid, result.outcome);
+            wait = false;
+            continue;
         }
-        curr_elm = queue_pop(&copy_queue);
+        if (!wait || stop_signal || dispatcher_in_flight() == 0) break;
+        poll_watch(-1);
     }
+    schedule_dispatch(NS_PER_SEC + rand() % 1000);
+}
+
+// Decide whether a request may be granted now. Called with alloc_lock held.
+bool can_grant(int sim_pid, int* requests) {
+    // Detection mode grants whatever fits and deals with deadlock when it happens
+    if (deadlock_mode == MODE_DETECT) return banker_fits(shared_mem, sim_pid, requests);
+    if (config.shards > 0) return shard_is_safe(sim_pid, requests);
+    return is_safe(sim_pid, requests);
+}
 
-    // Calculate needed matrix
-    for (int i = 0; i < size; i++) {
-        for (int j = 0; j < MAX_RES_INSTANCES; j++) {
-            need[i][j] = maximum[i][j] - allocated[i][j]; 
+// Find processes deadlocked on their parked requests and roll back victims until none are left.
+// A victim loses everything it holds and its parked request is denied, so it carries on from scratch.
+void detect_deadlock() {
+    char log_buf[100];
+    bool waiting[config.processes];
+    bool deadlocked[config.processes];
+    uint64_t now = clock_now(&shared_mem->sys_clock);
+    snprintf(log_buf, 100, "OSS running deadlock detection at %lu:%lu", (unsigned long)(now / NS_PER_SEC), (unsigned long)(now % NS_PER_SEC));
+    save_to_log(log_buf);
+    add_time(&shared_mem->sys_clock, 0, rand() % 1000000);
+
+    bool found = false;
+    while (true) {
+        pthread_mutex_lock(&alloc_lock);
+        for (int i = 0; i < config.processes; i++) {
+            waiting[i] = waitlist_is_waiting(i);
+        }
+        int count = banker_detect(shared_mem, waitlist_requests(), waiting, deadlocked);
+
+        // Cheapest victim holds the fewest instances, penalised for each earlier rollback.
+        // A process holding nothing frees nothing by being rolled back, so it is never picked.
+        struct banker_state* banker = shm_banker(shared_mem);
+        int victim = -1;
+        long victim_cost = 0;
+        for (int i = 0; i < config.processes && count > 0; i++) {
+            if (!deadlocked[i] || !waiting[i]) continue;
+            long held = 0;
+            for (int j = 0; j < config.resources; j++) {
+                held += banker_alloc(banker, i)[j];
+            }
+            if (held == 0) continue;
+            long cost = held + (long)rollbacks[i] * ROLLBACK_COST;
+            if (victim < 0 || cost < victim_cost) {
+                victim = i;
+                victim_cost = cost;
+            }
+        }
+        if (victim < 0) {
+            pthread_mutex_unlock(&alloc_lock);
+            break;
         }
+        mark_freed(victim);
+        banker_release(shared_mem, victim);
+        waitlist_unpark(victim);
+        trace_event(clock_now(&shared_mem->sys_clock), TRACE_ROLLBACK, victim, NULL);
+        pthread_mutex_unlock(&alloc_lock);
+
+        if (!found) stats.deadlocks++;
+        found = true;
+        stats.rollbacks++;
+        rollbacks[victim]++;
+        snprintf(log_buf, 100, "\tDeadlock among %d processes, rolling back P%d", count, victim);
+        save_to_log(log_buf);
+
+        // Deny the parked request. The process sees it holds nothing and starts over.
+        record_woken(&victim, 1);
+        msg_init(&msg, shm_pcb(shared_mem, victim)->actual_pid, MSG_DENIED, victim);
+        send_msg(&msg, PROC_MSG, false);
+        __atomic_add_fetch(&stats.denied_requests, 1, __ATOMIC_RELAXED);
+        sched_finish(victim, TURN_DENIED);
+
+        // What the victim gave back may be enough for the others
+        grant_parked();
     }
+    if (found) schedule_dispatch(0);
+}
+
+bool is_safe(int sim_pid, int* requests) {
+    char log_buf[100];
+    uint64_t now = clock_now(&shared_mem->sys_clock);
+    uint64_t wall_start = wall_now();
+    snprintf(log_buf, 100, "OSS running deadlock avoidance at %lu:%lu", (unsigned long)(now / NS_PER_SEC), (unsigned long)(now % NS_PER_SEC));
+    add_time(&shared_mem->sys_clock, 0, rand() % 1000000);
+    save_to_log(log_buf);
 
     // Output if in verbose mode and every 20 successful requests
     if (VERBOSE_MODE && ((stats.granted_requests % 20) == 0)) {
-        int buf_size = size * MAX_RES_INSTANCES * 8;
-        char buf[buf_size];
+        int rows = config.processes;
+        int cols = config.resources;
+        struct banker_state* banker = shm_banker(shared_mem);
+        int* need = malloc(rows * cols * sizeof(int));
+        int* maximum = malloc(rows * cols * sizeof(int));
+        int* allocated = malloc(rows * cols * sizeof(int));
+        int* available = malloc(cols * sizeof(int));
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < cols; j++) {
+                need[i * cols + j] = banker_need(banker, i)[j];
+                maximum[i * cols + j] = pcb_max_res(shared_mem, i)[j];
+                allocated[i * cols + j] = banker_alloc(banker, i)[j];
+            }
+        }
+        for (int j = 0; j < cols; j++) {
+            available[j] = banker_available(banker)[j];
+        }
+
+        // Header row plus one row per process, up to 6 characters per column
+        int buf_size = (rows + 1) * (cols + 2) * 6 + 1;
+        char* buf = malloc(buf_size);
         save_to_log("Need Matrix:");
-        matrix_to_string(buf, buf_size, &need[0][0], size, MAX_RES_INSTANCES);
+        matrix_to_string(buf, buf_size, need, rows, cols);
         save_to_log(buf);
 
         save_to_log("Maximum Matrix:");
-        matrix_to_string(buf, buf_size, &maximum[0][0], size, MAX_RES_INSTANCES);
+        matrix_to_string(buf, buf_size, maximum, rows, cols);
         save_to_log(buf);
 
         save_to_log("Allocated Matrix:");
-        matrix_to_string(buf, buf_size, &allocated[0][0], size, MAX_RES_INSTANCES);
+        matrix_to_string(buf, buf_size, allocated, rows, cols);
         save_to_log(buf);
 
         save_to_log("Available Array:");
-        matrix_to_string(buf, buf_size, available, 1, MAX_RES_INSTANCES);
+        matrix_to_string(buf, buf_size, available, 1, cols);
         save_to_log(buf);
 
         save_to_log("Request Array:");
-        matrix_to_string(buf, buf_size, requests, 1, MAX_RES_INSTANCES);
+        matrix_to_string(buf, buf_size, requests, 1, cols);
         save_to_log(buf);
-    }
 
-    int index = 0;
-    memcpy(&copy_queue, &proc_queue, sizeof(struct Queue));
-    curr_elm = queue_pop(&copy_queue);
-    while (!queue_is_empty(&copy_queue)) {
-        if (curr_elm == sim_pid) break;
-        index++;
-        curr_elm = queue_pop(&copy_queue);
+        free(buf);
+        free(need);
+        free(maximum);
+        free(allocated);
+        free(available);
     }
 
-    // resource request algo
-    for (int i = 0; i < MAX_RES_INSTANCES; i++) {
-        if (need[index][i] < requests[i]) {
-
-            // Unsafe
-            return false;
-        }
+    // Banker's safety check against the incrementally maintained need/available state
+    bool safe = banker_check(shared_mem, sim_pid, requests);
+    record_latency(LAT_IS_SAFE, now, wall_start);
+    return safe;
+}
 
-        if (requests[i] <= available[i]) {
-            available[i] -= requests[i];
-            allocated[index][i] += requests[i];
-            need[index][i] -= requests[i];
-        }
-        else {
-            // Unsafe
-            return false;
-        }
-    }
+// Sharded version of is_safe. Each shard runs the safety check on its own resources, and a
+// granted request is already held by the shards, so the caller only mirrors it in shm.
+bool shard_is_safe(int sim_pid, int* requests) {
+    char log_buf[100];
+    uint64_t now = clock_now(&shared_mem->sys_clock);
+    uint64_t wall_start = wall_now();
+    snprintf(log_buf, 100, "OSS running sharded deadlock avoidance at %lu:%lu", (unsigned long)(now / NS_PER_SEC), (unsigned long)(now % NS_PER_SEC));
+    add_time(&shared_mem->sys_clock, 0, rand() % 1000000);
+    save_to_log(log_buf);
 
-    return true;
+    bool safe = shard_grant(sim_pid, requests);
+    record_latency(LAT_IS_SAFE, now, wall_start);
+    return safe;
 }
 
 void matrix_to_string(char* dest, size_t buffer_size, int* matrix, int rows, int cols) {
-    strncpy(dest, "", buffer_size);
-    char buffer[buffer_size];
-    strncat(dest, "    ", buffer_size);
-    for (int i = 1; i <= MAX_RES_INSTANCES; i++) {
-        snprintf(buffer, buffer_size, "R%-2d ", i);
-        strncat(dest, buffer, buffer_size);
-    }
-    strncat(dest, "\n", buffer_size);
-
-    for (int i = 0; i < rows; i++) {
-        snprintf(buffer, buffer_size, "P%-3d", i);
-        strncat(dest, buffer, buffer_size);
-        for (int j = 0; j < cols; j++) {
-            snprintf(buffer, buffer_size, "%-3d ", matrix[i * cols + j]);
-            strncat(dest, buffer, buffer_size);
+    // Append with a running length so large matrices stay linear
+    size_t len = 0;
+    dest[0] = '\0';
+    len += snprintf(dest + len, buffer_size - len, "    ");
+    for (int i = 1; i <= cols && len < buffer_size; i++) {
+        len += snprintf(dest + len, buffer_size - len, "R%-2d ", i);
+    }
+    if (len < buffer_size) len += snprintf(dest + len, buffer_size - len, "\n");
+
+    for (int i = 0; i < rows && len < buffer_size; i++) {
+        len += snprintf(dest + len, buffer_size - len, "P%-3d", i);
+        for (int j = 0; j < cols && len < buffer_size; j++) {
+            len += snprintf(dest + len, buffer_size - len, "%-3d ", matrix[i * cols + j]);
         }
-        if (i != rows - 1) strncat(dest, "\n", buffer_size);
+        if (i != rows - 1 && len < buffer_size) len += snprintf(dest + len, buffer_size - len, "\n");
     }
 }
 
@@ -468,32 +1422,348 @@ void output_stats() {
     printf("--REQUESTS\n");
     printf("\t%-12s %d\n", "DENIED:", stats.denied_requests);
     printf("\t%-12s %d\n", "GRANTED:", stats.granted_requests);
+    printf("\t%-12s %d\n", "PARKED:", stats.parked_requests);
     printf("\t%-12s %d\n", "TOTAL:", stats.granted_requests + stats.denied_requests);
+    printf("--DEADLOCKS (%s)\n", deadlock_mode == MODE_DETECT ? "detect" : "avoid");
+    printf("\t%-12s %d\n", "DETECTED:", stats.deadlocks);
+    printf("\t%-12s %d\n", "ROLLBACKS:", stats.rollbacks);
+    if (config.batch > 1) {
+        printf("--BATCHES (up to %d operations)\n", config.batch);
+        printf("\t%-12s %u\n", "TURNS:", stats.batches);
+        printf("\t%-12s %u\n", "OPERATIONS:", stats.batched_ops);
+        printf("\t%-12s %.2f\n", "PER TURN:", stats.batches > 0 ? (double)stats.batched_ops / stats.batches : 0.0);
+    }
     printf("--TERMINATIONS\n");
     printf("\t%-12s %d\n", "TOTAL:", stats.terminations);
+    printf("\t%-12s %d\n", "LOST:", stats.lost);
     printf("--RELEASES\n");
     printf("\t%-12s %d\n", "TOTAL:", stats.releases);
+    printf("--SCHEDULER (%s%s)\n", sched_name(), wait_queue ? ", wait queue" : "");
+    printf("\t%-12s %d\n", "WAKEUPS:", stats.wakeups);
+    printf("\t%-12s %d\n", "FORCED:", stats.forced_wakeups);
+    if (config.shards > 0) {
+        struct shard_stats shards;
+        shard_get_stats(&shards);
+        printf("--SHARDS (%d)\n", config.shards);
+        printf("\t%-12s %lu\n", "SINGLE:", shards.single);
+        printf("\t%-12s %lu\n", "SPANNING:", shards.spanning);
+        printf("\t%-12s %lu\n", "ABORTED:", shards.aborts);
+        for (int s = 0; s < config.shards; s++) {
+            printf("\tS%-11d %lu decisions\n", s, shards.decisions[s]);
+        }
+    }
+    // Rates over the simulated run so far
+    double sim_secs = (double)clock_now(&shared_mem->sys_clock) / NS_PER_SEC;
+    if (sim_secs <= 0.0) sim_secs = 1.0;
+    printf("--THROUGHPUT (per simulated second)\n");
+    printf("\t%-12s %.3f\n", "REQUESTS:", (stats.granted_requests + stats.denied_requests) / sim_secs);
+    printf("\t%-12s %.3f\n", "GRANTS:", stats.granted_requests / sim_secs);
+    printf("\t%-12s %.3f\n", "RELEASES:", stats.releases / sim_secs);
+    printf("\t%-12s %.3f\n", "TERMINATES:", stats.terminations / sim_secs);
+    printf("--LATENCY (simulated, ms)\n");
+    for (int i = 0; i < LAT_METRICS; i++) {
+        hist_print(stdout, latency_names[i], &sim_latency[i], 1000000.0, "ms");
+    }
+    printf("--LATENCY (wall clock, us)\n");
+    for (int i = 0; i < LAT_METRICS; i++) {
+        hist_print(stdout, latency_names[i], &wall_latency[i], 1000.0, "us");
+    }
+    printf("--LOG\n");
+    printf("\t%-12s %lu\n", "DROPPED:", log_dropped());
     printf("--SIMULATED TIME\n");
-    printf("\t%-12s %ld\n", "SECONDS:", shared_mem->sys_clock.seconds);
-    printf("\t%-12s %ld\n", "NANOSECONDS:", shared_mem->sys_clock.nanoseconds);
+    unsigned long seconds, nanoseconds;
+    clock_read(&shared_mem->sys_clock, &seconds, &nanoseconds);
+    printf("\t%-12s %lu\n", "SECONDS:", seconds);
+    printf("\t%-12s %lu\n", "NANOSECONDS:", nanoseconds);
     printf("\n");
 }
 
-void save_to_log(char* text) {
-	FILE* file_log = fopen(LOG_FILE, "a+");
-    log_line++;
-    if (log_line > LOG_FILE_MAX) {
-        errno = EINVAL;
-        perror("Log file has exceeded max length.");
+// Feed a recorded trace through the allocator without forking any children. Every request is
+// decided again in the current -m mode, timed, and compared with what the recording decided.
+void replay_trace(const char* path) {
+    struct trace_header header;
+    int16_t totals[RESOURCES_LIMIT];
+    int16_t shared[RESOURCES_LIMIT];
+    FILE* file = trace_read_open(path, &header, totals, shared, RESOURCES_LIMIT);
+    if (file == NULL) exit(EXIT_FAILURE);
+    config.processes = header.num_procs;
+    config.resources = header.num_res;
+    if (!config_validate(&config)) exit(EXIT_FAILURE);
+
+    // A private copy of the shm layout; nothing else attaches to it
+    size_t size = oss_shm_size(&config);
+    shared_mem = aligned_alloc(CACHE_LINE, size);
+    if (shared_mem == NULL) {
+        perror("Could not allocate replay state");
+        exit(EXIT_FAILURE);
+    }
+    memset(shared_mem, 0, size);
+    oss_shm_layout(shared_mem, &config);
+    for (int i = 0; i < config.resources; i++) {
+        shm_descr(shared_mem, i)->resource = totals[i];
+        shm_descr(shared_mem, i)->is_shared = shared[i];
+    }
+    banker_init(shared_mem);
+
+    int num_res = config.resources;
+    int* pending = calloc(config.processes * num_res, sizeof(int));
+    bool* has_pending = calloc(config.processes, sizeof(bool));
+    bool* decided = calloc(config.processes, sizeof(bool));
+    int request[num_res];
+    int16_t vector[RESOURCES_LIMIT];
+    struct trace_record record;
+    struct histogram check_time;
+    hist_init(&check_time);
+    unsigned long events = 0, decisions = 0, granted = 0, denied = 0, mismatches = 0;
+
+    uint64_t start = wall_now();
+    while (trace_read(file, &record, vector, RESOURCES_LIMIT)) {
+        int sim_pid = record.sim_pid;
+        if (sim_pid < 0 || sim_pid >= config.processes) continue;
+        events++;
+        switch (record.type) {
+            case TRACE_ADMIT: {
+                int16_t* max_res = pcb_max_res(shared_mem, sim_pid);
+                for (int i = 0; i < num_res; i++) {
+                    max_res[i] = vector[i];
+                }
+                banker_admit(shared_mem, sim_pid);
+                has_pending[sim_pid] = false;
+                break;
+            }
+            case TRACE_REQUEST: {
+                for (int i = 0; i < num_res; i++) {
+                    request[i] = vector[i];
+                }
+                uint64_t check_start = wall_now();
+                bool allowed = deadlock_mode == MODE_DETECT ? banker_fits(shared_mem, sim_pid, request) : banker_check(shared_mem, sim_pid, request);
+                if (allowed) banker_grant(shared_mem, sim_pid, request);
+                hist_record(&check_time, wall_now() - check_start);
+                decisions++;
+                if (allowed) {
+                    granted++;
+                }
+                else {
+                    denied++;
+                    memcpy(&pending[sim_pid * num_res], request, sizeof(request));
+                }
+                has_pending[sim_pid] = !allowed;
+                decided[sim_pid] = allowed;
+                break;
+            }
+            case TRACE_GRANT:
+                if (!decided[sim_pid]) mismatches++;
+                break;
+            case TRACE_DENY:
+            case TRACE_PARK:
+                if (decided[sim_pid]) mismatches++;
+                break;
+            case TRACE_GRANT_PARKED:
+                // The recording granted a parked request here, so grant the one we held back
+                if (has_pending[sim_pid] && banker_fits(shared_mem, sim_pid, &pending[sim_pid * num_res])) {
+                    banker_grant(shared_mem, sim_pid, &pending[sim_pid * num_res]);
+                    granted++;
+                }
+                has_pending[sim_pid] = false;
+                break;
+            case TRACE_RELEASE:
+            case TRACE_ROLLBACK:
+                banker_release(shared_mem, sim_pid);
+                has_pending[sim_pid] = false;
+                break;
+            case TRACE_TERMINATE:
+                banker_remove(shared_mem, sim_pid);
+                has_pending[sim_pid] = false;
+                break;
+        }
     }
+    double elapsed = (double)(wall_now() - start) / NS_PER_SEC;
+    fclose(file);
 
-    // Make sure file is opened
-	if (file_log == NULL) {
-		perror("Could not open logfile");
-        return;
-	}
+    printf("\n");
+    printf("| REPLAY |\n");
+    printf("--TRACE\n");
+    printf("\t%-12s %s\n", "FILE:", path);
+    printf("\t%-12s %d x %d\n", "SYSTEM:", config.processes, config.resources);
+    printf("\t%-12s %lu\n", "SEED:", (unsigned long)header.seed);
+    printf("\t%-12s %lu\n", "EVENTS:", events);
+    printf("--DECISIONS (%s, %s kernel)\n", deadlock_mode == MODE_DETECT ? "detect" : "avoid", banker_kernel_name());
+    printf("\t%-12s %lu\n", "TOTAL:", decisions);
+    printf("\t%-12s %lu\n", "GRANTED:", granted);
+    printf("\t%-12s %lu\n", "DENIED:", denied);
+    printf("\t%-12s %lu\n", "MISMATCHES:", mismatches);
+    printf("--THROUGHPUT\n");
+    printf("\t%-12s %.3f\n", "WALL MS:", elapsed * 1000.0);
+    printf("\t%-12s %.0f\n", "EVENTS/S:", elapsed > 0.0 ? events / elapsed : 0.0);
+    printf("\t%-12s %.0f\n", "DECISIONS/S:", elapsed > 0.0 ? decisions / elapsed : 0.0);
+    printf("--LATENCY (wall clock, ns)\n");
+    hist_print(stdout, "check", &check_time, 1.0, "ns");
+    printf("\n");
+
+    free(pending);
+    free(has_pending);
+    free(decided);
+    free(shared_mem);
+}
+
+// Context switch counts of another process from /proc. Returns false if it has gone.
+bool read_ctxt_switches(pid_t pid, long* voluntary, long* involuntary) {
+    char path[64], line[128];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return false;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        sscanf(line, "voluntary_ctxt_switches: %ld", voluntary);
+        sscanf(line, "nonvoluntary_ctxt_switches: %ld", involuntary);
+    }
+    fclose(file);
+    return true;
+}
+
+// Sum the context switches of every benchmark child
+void children_ctxt_switches(long* voluntary, long* involuntary) {
+    *voluntary = 0;
+    *involuntary = 0;
+    for (int sim_pid = 0; sim_pid < config.processes; sim_pid++) {
+        long vol = 0, invol = 0;
+        if (workers[sim_pid] > 0 && read_ctxt_switches(workers[sim_pid], &vol, &invol)) {
+            *voluntary += vol;
+            *involuntary += invol;
+        }
+    }
+}
+
+// One dispatch turn: a run message out, the child's request (or batch of requests) back,
+// and the answer to it
+int bench_round_trip(int sim_pid, struct message* msg) {
+    int num_ops = 1;
+    uint64_t start = wall_now();
+    msg_init(msg, workers[sim_pid], MSG_RUN, sim_pid);
+    send_msg(msg, PROC_MSG, false);
+    msg_init(msg, workers[sim_pid], MSG_REQUEST, sim_pid);
+    if (!watch_reply(shared_mem, sim_pid, msg)) return 0;
+    if (msg->opcode == MSG_BATCH) {
+        num_ops = msg->num_ops;
+        msg_init(msg, workers[sim_pid], MSG_RESULTS, sim_pid);
+        for (int i = 0; i < num_ops; i++) {
+            msg->resources[i] = MSG_ACQUIRED;
+        }
+        msg->num_ops = num_ops;
+        msg->num_res = num_ops;
+    }
+    else {
+        msg_init(msg, workers[sim_pid], MSG_ACQUIRED, sim_pid);
+    }
+    send_msg(msg, PROC_MSG, false);
+    hist_record(&bench_latency, wall_now() - start);
+    return num_ops;
+}
 
-    fprintf(file_log, "%s\n", text);
+struct bench_share {
+    int first;
+    int stride;
+    long rounds;
+    long ops;
+};
+
+// Serve one thread's share of the children round robin
+void* bench_thread(void* arg) {
+    struct bench_share* share = arg;
+    struct message msg;
+    int sim_pid = share->first;
+    for (long n = 0; n < share->rounds && !stop_signal; n++) {
+        share->ops += bench_round_trip(sim_pid, &msg);
+        sim_pid += share->stride;
+        if (sim_pid >= config.processes) sim_pid = share->first;
+    }
+    return NULL;
+}
+
+// Run rounds dispatch round trips against config.processes echo children over the
+// current transport, split across the -d threads (or inline), and report the throughput,
+// latency and context switches they cost
+void bench_ipc(long rounds) {
+    int threads = dispatch_threads > 0 ? dispatch_threads : 1;
+    if (threads > config.processes) threads = config.processes;
+    hist_init(&bench_latency);
+    start_workers();
+
+    // One untimed round trip each so exec and attach are not counted
+    struct message warmup;
+    for (int sim_pid = 0; sim_pid < config.processes; sim_pid++) {
+        bench_round_trip(sim_pid, &warmup);
+    }
+    hist_init(&bench_latency);
+
+    struct rusage usage_start, usage_end;
+    long child_vol_start, child_invol_start, child_vol_end, child_invol_end;
+    children_ctxt_switches(&child_vol_start, &child_invol_start);
+    getrusage(RUSAGE_SELF, &usage_start);
+    uint64_t start = wall_now();
+
+    struct bench_share shares[threads];
+    pthread_t ids[threads];
+    for (int t = 0; t < threads; t++) {
+        shares[t].first = t;
+        shares[t].stride = threads;
+        shares[t].rounds = rounds / threads + (t < rounds % threads ? 1 : 0);
+        shares[t].ops = 0;
+    }
+    if (dispatch_threads == 0) {
+        bench_thread(&shares[0]);
+    }
+    else {
+        for (int t = 0; t < threads; t++) {
+            pthread_create(&ids[t], NULL, bench_thread, &shares[t]);
+        }
+        for (int t = 0; t < threads; t++) {
+            pthread_join(ids[t], NULL);
+        }
+    }
 
-    fclose(file_log);
-}
\ No newline at end of file
+    if (stop_signal) return;
+    double elapsed = (double)(wall_now() - start) / NS_PER_SEC;
+    long ops = 0;
+    for (int t = 0; t < threads; t++) {
+        ops += shares[t].ops;
+    }
+    getrusage(RUSAGE_SELF, &usage_end);
+    children_ctxt_switches(&child_vol_end, &child_invol_end);
+    stop_workers();
+    if (elapsed <= 0.0) elapsed = 1e-9;
+
+    long oss_vol = usage_end.ru_nvcsw - usage_start.ru_nvcsw;
+    long oss_invol = usage_end.ru_nivcsw - usage_start.ru_nivcsw;
+    long child_vol = child_vol_end - child_vol_start;
+    long child_invol = child_invol_end - child_invol_start;
+    printf("\n");
+    printf("| IPC BENCHMARK |\n");
+    printf("--SETUP\n");
+    printf("\t%-16s %s\n", "TRANSPORT:", shared_mem->transport == TRANSPORT_RING ? "ring" : "msgq");
+    printf("\t%-16s %d\n", "CHILDREN:", config.processes);
+    printf("\t%-16s %d%s\n", "THREADS:", threads, dispatch_threads == 0 ? " (inline)" : "");
+    printf("\t%-16s %ld\n", "ROUND TRIPS:", rounds);
+    printf("\t%-16s %d\n", "BATCH:", config.batch);
+    printf("--THROUGHPUT\n");
+    printf("\t%-16s %.3f\n", "WALL MS:", elapsed * 1000.0);
+    printf("\t%-16s %.0f\n", "ROUND TRIPS/S:", rounds / elapsed);
+    printf("\t%-16s %.0f\n", "MESSAGES/S:", 3 * rounds / elapsed);
+    // Operations the replies actually carried. The echo children never reach the allocator,
+    // so this is the IPC cost per operation, not allocator throughput.
+    printf("\t%-16s %ld\n", "OPERATIONS:", ops);
+    printf("\t%-16s %.0f\n", "OPERATIONS/S:", ops / elapsed);
+    printf("--LATENCY (wall clock, us)\n");
+    hist_print(stdout, "round_trip", &bench_latency, 1000.0, "us");
+    printf("--CONTEXT SWITCHES\n");
+    printf("\t%-16s %ld\n", "OSS VOLUNTARY:", oss_vol);
+    printf("\t%-16s %ld\n", "OSS INVOLUNTARY:", oss_invol);
+    printf("\t%-16s %ld\n", "CHILD VOLUNTARY:", child_vol);
+    printf("\t%-16s %ld\n", "CHILD INVOLUNTARY:", child_invol);
+    printf("\t%-16s %.2f\n", "PER ROUND TRIP:", (double)(oss_vol + oss_invol + child_vol + child_invol) / rounds);
+    printf("\n");
+}
+
+void save_to_log(char* text) {
+    // Buffered; written and rotated by the log writer thread
+    log_write(text);
+}
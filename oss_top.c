@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/shm.h>
+
+#include "shared.h"
+#include "config.h"
+
+#define BAR_WIDTH 20
+
+static char* exe_name;
+static int interval_ms = 1000;
+static int iterations = 0;
+
+void help() {
+    printf("OSS live monitor usage\n");
+    printf("Attaches read-only to a running oss and shows its metrics page.\n");
+    printf("[-h]\tShow this help dialogue.\n");
+    printf("[-i ms]\tRefresh interval in milliseconds (default 1000).\n");
+    printf("[-n count]\tExit after this many refreshes (default 0, until oss exits).\n");
+}
+
+// Rate of a counter between two snapshots, per second of the given elapsed nanoseconds
+double rate(uint32_t now, uint32_t before, uint64_t elapsed_ns) {
+    if (elapsed_ns == 0) return 0.0;
+    return (double)(now - before) * NS_PER_SEC / elapsed_ns;
+}
+
+// Print one counter with its rate per wall second and per simulated second
+void print_counter(const char* name, uint32_t now, uint32_t before, uint64_t wall_ns, uint64_t sim_ns) {
+    printf("  %-14s %10u  %10.1f/s  %10.3f/sim s\n", name, now, rate(now, before, wall_ns), rate(now, before, sim_ns));
+}
+
+void show(struct oss_metrics* now, struct oss_metrics* before, int16_t* allocated, int16_t* total) {
+    uint64_t wall_ns = now->wall_time_ns - before->wall_time_ns;
+    uint64_t sim_ns = now->sim_time_ns - before->sim_time_ns;
+
+    // Redraw in place on a terminal, append otherwise
+    if (isatty(STDOUT_FILENO)) printf("\033[H\033[J");
+    printf("oss_top - oss pid %d, simulated time %lu.%09lu\n", (int)now->oss_pid,
+        (unsigned long)(now->sim_time_ns / NS_PER_SEC), (unsigned long)(now->sim_time_ns % NS_PER_SEC));
+    printf("  processes %u live, %u started | %u ready, %u blocked, %u parked\n",
+        now->children, now->total_procs, now->ready, now->blocked, now->waiting);
+    printf("\n  %-14s %10s  %12s  %16s\n", "COUNTER", "TOTAL", "WALL RATE", "SIM RATE");
+    print_counter("granted", now->granted, before->granted, wall_ns, sim_ns);
+    print_counter("denied", now->denied, before->denied, wall_ns, sim_ns);
+    print_counter("parked", now->parked, before->parked, wall_ns, sim_ns);
+    print_counter("releases", now->releases, before->releases, wall_ns, sim_ns);
+    print_counter("terminations", now->terminations, before->terminations, wall_ns, sim_ns);
+    print_counter("deadlocks", now->deadlocks, before->deadlocks, wall_ns, sim_ns);
+    print_counter("rollbacks", now->rollbacks, before->rollbacks, wall_ns, sim_ns);
+
+    printf("\n  RESOURCE UTILIZATION\n");
+    for (uint32_t i = 0; i < now->num_res; i++) {
+        int filled = total[i] > 0 ? allocated[i] * BAR_WIDTH / total[i] : 0;
+        char bar[BAR_WIDTH + 1];
+        memset(bar, '.', BAR_WIDTH);
+        memset(bar, '#', filled);
+        bar[BAR_WIDTH] = '\0';
+        printf("  R%-4u %3d/%-3d [%s]\n", i, allocated[i], total[i], bar);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    int option;
+    exe_name = argv[0];
+
+    while ((option = getopt(argc, argv, "hi:n:")) != -1) {
+        switch (option) {
+            case 'h':
+                help();
+                exit(EXIT_SUCCESS);
+            case 'i':
+                interval_ms = atoi(optarg);
+                if (interval_ms < 1) {
+                    fprintf(stderr, "%s: interval must be at least 1ms\n", exe_name);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case '?':
+                // Getopt handles error messages
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    struct oss_shm* shm = attach_oss_readonly();
+    if (shm == NULL) {
+        fprintf(stderr, "%s: could not attach to oss shared memory, is oss running?\n", exe_name);
+        exit(EXIT_FAILURE);
+    }
+
+    struct oss_metrics* page = shm_metrics(shm);
+    struct oss_metrics now, before;
+    int num_res = page->num_res;
+    int16_t* allocated = calloc(num_res, sizeof(int16_t));
+    int16_t* total = calloc(num_res, sizeof(int16_t));
+    if (!metrics_read(page, &before, allocated, total)) {
+        fprintf(stderr, "%s: metrics page version does not match, rebuild oss_top\n", exe_name);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; iterations == 0 || i < iterations; i++) {
+        usleep(interval_ms * 1000);
+        metrics_read(page, &now, allocated, total);
+        show(&now, &before, allocated, total);
+        before = now;
+
+        // Stop once oss has finished or been killed
+        if (!now.running || (kill(now.oss_pid, 0) < 0 && errno == ESRCH)) {
+            printf("oss is no longer running\n");
+            break;
+        }
+    }
+
+    shmdt(shm);
+    free(allocated);
+    free(total);
+    exit(EXIT_SUCCESS);
+}
@@ -1,45 +1,121 @@
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "queue.h"
 
-void queue_init(struct Queue* queue) {
-    queue->front_ind = 0;
+#define QUEUE_CACHE_LINE 64
+// Marks an element that is not in the queue. -1 marks the end of the list.
+#define QUEUE_ABSENT -2
+
+// Private function to allocate a cache line aligned int array of count entries set to QUEUE_ABSENT
+static int* queue_alloc(size_t count) {
+    size_t bytes = (count * sizeof(int) + QUEUE_CACHE_LINE - 1) / QUEUE_CACHE_LINE * QUEUE_CACHE_LINE;
+    int* array = aligned_alloc(QUEUE_CACHE_LINE, bytes);
+    if (array == NULL) return NULL;
+    for (size_t i = 0; i < count; i++) {
+        array[i] = QUEUE_ABSENT;
+    }
+    return array;
+}
+
+// Private function to grow the index so element fits
+static bool queue_grow(struct Queue* queue, size_t element) {
+    size_t capacity = queue->capacity > 0 ? queue->capacity : 1;
+    while (capacity <= element) capacity *= 2;
+
+    int* next = queue_alloc(capacity);
+    int* prev = queue_alloc(capacity);
+    if (next == NULL || prev == NULL) {
+        perror("Could not grow queue");
+        free(next);
+        free(prev);
+        return false;
+    }
+    if (queue->capacity > 0) {
+        memcpy(next, queue->next, queue->capacity * sizeof(int));
+        memcpy(prev, queue->prev, queue->capacity * sizeof(int));
+    }
+    free(queue->next);
+    free(queue->prev);
+    queue->next = next;
+    queue->prev = prev;
+    queue->capacity = capacity;
+    return true;
+}
+
+void queue_init(struct Queue* queue, size_t capacity) {
+    queue->next = NULL;
+    queue->prev = NULL;
+    queue->capacity = 0;
+    queue->front_ind = -1;
     queue->rear_ind = -1;
     queue->size = 0;
+    if (capacity > 0) queue_grow(queue, capacity - 1);
+}
+
+void queue_free(struct Queue* queue) {
+    free(queue->next);
+    free(queue->prev);
+    queue->next = NULL;
+    queue->prev = NULL;
+    queue->capacity = 0;
+    queue->size = 0;
+    queue->front_ind = -1;
+    queue->rear_ind = -1;
 }
 
 int queue_pop(struct Queue* queue) {
     if (queue_is_empty(queue)) return -1;
-    int element = queue->elements[queue->front_ind];
-    queue->elements[queue->front_ind++] = 0;
-
-    if (queue->front_ind == MAX_ELEMENTS) {
-        queue->front_ind = 0;
-    }
-
-    queue->size--;
+    int element = queue->front_ind;
+    queue_remove(queue, element);
     return element;
 }
 
 int queue_peek(struct Queue* queue) {
     if (queue_is_empty(queue)) return -1;
-    return queue->elements[queue->front_ind];
+    return queue->front_ind;
 }
 
+// Add element to the back. Elements already queued are left where they are.
 void queue_insert(struct Queue* queue, int element) {
-    if (queue_is_full(queue)) return;
-    if (queue->rear_ind == MAX_ELEMENTS - 1) {
-        queue->rear_ind = -1;
-    }
+    if (element < 0) return;
+    if ((size_t)element >= queue->capacity && !queue_grow(queue, element)) return;
+    if (queue->next[element] != QUEUE_ABSENT) return;
 
-    queue->elements[++queue->rear_ind] = element;
+    queue->next[element] = -1;
+    queue->prev[element] = queue->rear_ind;
+    if (queue->rear_ind >= 0) queue->next[queue->rear_ind] = element;
+    else queue->front_ind = element;
+    queue->rear_ind = element;
     queue->size++;
-    
 }
 
+// Take element out from wherever it is in the queue. Returns false if it was not queued.
+bool queue_remove(struct Queue* queue, int element) {
+    if (!queue_contains(queue, element)) return false;
+    int next = queue->next[element];
+    int prev = queue->prev[element];
+
+    if (prev >= 0) queue->next[prev] = next;
+    else queue->front_ind = next;
+    if (next >= 0) queue->prev[next] = prev;
+    else queue->rear_ind = prev;
+
+    queue->next[element] = QUEUE_ABSENT;
+    queue->prev[element] = QUEUE_ABSENT;
+    queue->size--;
+    return true;
+}
+
+bool queue_contains(struct Queue* queue, int element) {
+    if (element < 0 || (size_t)element >= queue->capacity) return false;
+    return queue->next[element] != QUEUE_ABSENT;
+}
+
+// The queue grows as needed, so it is never full
 bool queue_is_full(struct Queue* queue) {
-    return queue->size == MAX_ELEMENTS;
+    return false;
 }
 
 bool queue_is_empty(struct Queue* queue) {
@@ -48,8 +124,8 @@ bool queue_is_empty(struct Queue* queue) {
 
 void queue_print(struct Queue* queue) {
     printf("[");
-    for (int i = queue->front_ind; i < queue->rear_ind; i++){
-        printf("%d, ", queue->elements[i]);
+    for (int i = queue->front_ind; i >= 0; i = queue->next[i]) {
+        printf(queue->next[i] >= 0 ? "%d, " : "%d", i);
     }
     printf("]");
 }
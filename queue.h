@@ -5,19 +5,25 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-#define MAX_ELEMENTS 100
-
+// FIFO queue of unique non-negative ints (sim_pids). Stored as an intrusive
+// doubly linked list indexed by element, so finding, removing and requeueing
+// an element are O(1) and never move data. Grows to fit larger elements.
 struct Queue {
     int front_ind;
     int rear_ind;
-    int elements[MAX_ELEMENTS];
+    int* next;
+    int* prev;
+    size_t capacity;
     size_t size;
 };
 
-void queue_init(struct Queue* queue);
+void queue_init(struct Queue* queue, size_t capacity);
+void queue_free(struct Queue* queue);
 int queue_pop(struct Queue* queue);
 int queue_peek(struct Queue* queue);
 void queue_insert(struct Queue* queue, int element);
+bool queue_remove(struct Queue* queue, int element);
+bool queue_contains(struct Queue* queue, int element);
 bool queue_is_full(struct Queue* queue);
 bool queue_is_empty(struct Queue* queue);
 void queue_print(struct Queue* queue);
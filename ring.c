@@ -0,0 +1,68 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "ring.h"
+
+// Private function to sleep while the futex word still holds val
+static void futex_wait(uint32_t* addr, uint32_t val) {
+	syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+// Private function to wake one sleeper on the futex word
+static void futex_wake(uint32_t* addr) {
+	syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Public function to reset a ring to empty
+void ring_init(struct msg_ring* ring) {
+	__atomic_store_n(&ring->head, 0, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&ring->tail, 0, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&ring->futex, 0, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&ring->waiters, 0, __ATOMIC_SEQ_CST);
+}
+
+// Public function to add a message to the ring. Only the producer may call this.
+// Returns false if the ring is full and we are not waiting.
+bool ring_push(struct msg_ring* ring, const struct message* msg, bool wait) {
+	uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >= RING_SLOTS) {
+		if (!wait) return false;
+		sched_yield();
+	}
+
+	memcpy(&ring->slots[tail & (RING_SLOTS - 1)], msg, sizeof(struct message));
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+	// Only pay for the syscall if the consumer went to sleep
+	__atomic_add_fetch(&ring->futex, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_exchange_n(&ring->waiters, 0, __ATOMIC_SEQ_CST)) {
+		futex_wake(&ring->futex);
+	}
+	return true;
+}
+
+// Public function to take a message off the ring. Only the consumer may call this.
+// Returns false if the ring is empty and we are not waiting.
+bool ring_pop(struct msg_ring* ring, struct message* msg, bool wait) {
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	while (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == head) {
+		if (!wait) return false;
+
+		// Announce we are sleeping, then re-check before blocking so a push
+		// in between either wakes us or changes the futex word.
+		__atomic_store_n(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+		uint32_t seq = __atomic_load_n(&ring->futex, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) != head) break;
+		futex_wait(&ring->futex, seq);
+	}
+
+	memcpy(msg, &ring->slots[head & (RING_SLOTS - 1)], sizeof(struct message));
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
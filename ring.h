@@ -0,0 +1,33 @@
+#ifndef __RING_H
+#define __RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "message.h"
+
+// Number of messages a ring can hold. Must be a power of two.
+#define RING_SLOTS 8
+#define CACHE_LINE 64
+
+// Single-producer/single-consumer ring of messages living in shared memory.
+// The consumer only sleeps on the futex word when the ring is empty.
+struct msg_ring {
+    uint32_t head __attribute__((aligned(CACHE_LINE)));
+    uint32_t tail __attribute__((aligned(CACHE_LINE)));
+    uint32_t futex __attribute__((aligned(CACHE_LINE)));
+    uint32_t waiters;
+    struct message slots[RING_SLOTS];
+};
+
+// One pair of rings per process table slot
+struct proc_channel {
+    struct msg_ring to_oss;
+    struct msg_ring to_proc;
+};
+
+void ring_init(struct msg_ring* ring);
+bool ring_push(struct msg_ring* ring, const struct message* msg, bool wait);
+bool ring_pop(struct msg_ring* ring, struct message* msg, bool wait);
+
+#endif
@@ -0,0 +1,63 @@
+#include <stdint.h>
+
+#include "rng.h"
+
+// Private function to rotate x left by k bits
+static inline uint64_t rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+// Public function to seed the state. The seed is spread with splitmix64 so that
+// nearby seeds (like consecutive spawn numbers) give unrelated streams.
+void rng_seed(struct rng* rng, uint64_t seed) {
+	for (int i = 0; i < 4; i++) {
+		uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		rng->s[i] = z ^ (z >> 31);
+	}
+}
+
+uint64_t rng_next(struct rng* rng) {
+	uint64_t* s = rng->s;
+	uint64_t result = rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return result;
+}
+
+// Public function to get a number in [0, bound) by multiply-shift instead of a division
+uint32_t rng_below(struct rng* rng, uint32_t bound) {
+	return (uint32_t)(((rng_next(rng) >> 32) * bound) >> 32);
+}
+
+// Public function to get a double in [0, 1)
+double rng_double(struct rng* rng) {
+	return (rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+// Public function to fill out[i] with a number in [0, bounds[i]) for every i. Each
+// 64-bit draw is split into four 16-bit lanes, so a vector costs count / 4 draws.
+// Bounds are small resource counts, so the bias of a 16-bit multiply-shift is negligible.
+void rng_fill_below(struct rng* rng, int16_t* out, const int16_t* bounds, int count) {
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		uint64_t bits = rng_next(rng);
+		for (int lane = 0; lane < 4; lane++) {
+			uint32_t r = (uint16_t)(bits >> (16 * lane));
+			out[i + lane] = (int16_t)((r * (uint16_t)bounds[i + lane]) >> 16);
+		}
+	}
+	if (i < count) {
+		uint64_t bits = rng_next(rng);
+		for (int lane = 0; i < count; i++, lane++) {
+			uint32_t r = (uint16_t)(bits >> (16 * lane));
+			out[i] = (int16_t)((r * (uint16_t)bounds[i]) >> 16);
+		}
+	}
+}
@@ -0,0 +1,18 @@
+#ifndef __RNG_H
+#define __RNG_H
+
+#include <stdint.h>
+
+// xoshiro256** generator. Each process keeps its own state, so drawing numbers
+// touches no shared state and costs a few instructions instead of a rand() call.
+struct rng {
+    uint64_t s[4];
+};
+
+void rng_seed(struct rng* rng, uint64_t seed);
+uint64_t rng_next(struct rng* rng);
+uint32_t rng_below(struct rng* rng, uint32_t bound);
+double rng_double(struct rng* rng);
+void rng_fill_below(struct rng* rng, int16_t* out, const int16_t* bounds, int count);
+
+#endif
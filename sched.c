@@ -0,0 +1,234 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sched.h"
+#include "queue.h"
+
+static const struct sched_policy* policy = NULL;
+static bool use_wait_queue = false;
+static int num_resources = 0;
+static struct Queue blocked;
+static int16_t* requests = NULL;
+
+// --- Round robin: one FIFO, every turn goes to the back ---
+
+static struct Queue rr_queue;
+
+static void rr_init(int max_procs) {
+	queue_init(&rr_queue, max_procs);
+}
+
+static void rr_free() {
+	queue_free(&rr_queue);
+}
+
+static void rr_add(int sim_pid) {
+	queue_insert(&rr_queue, sim_pid);
+}
+
+static int rr_next() {
+	return queue_pop(&rr_queue);
+}
+
+static void rr_requeue(int sim_pid, int outcome) {
+	queue_insert(&rr_queue, sim_pid);
+}
+
+static void rr_remove(int sim_pid) {
+	queue_remove(&rr_queue, sim_pid);
+}
+
+static size_t rr_ready() {
+	return rr_queue.size;
+}
+
+// --- Multi-level feedback: denied processes drop a level, productive ones rise ---
+
+static struct Queue mlfq_queues[MLFQ_LEVELS];
+static int* mlfq_level = NULL;
+static int mlfq_turns = 0;
+
+static void mlfq_init(int max_procs) {
+	for (int i = 0; i < MLFQ_LEVELS; i++) {
+		queue_init(&mlfq_queues[i], max_procs);
+	}
+	mlfq_level = calloc(max_procs, sizeof(int));
+	mlfq_turns = 0;
+}
+
+static void mlfq_free() {
+	for (int i = 0; i < MLFQ_LEVELS; i++) {
+		queue_free(&mlfq_queues[i]);
+	}
+	free(mlfq_level);
+	mlfq_level = NULL;
+}
+
+static void mlfq_add(int sim_pid) {
+	mlfq_level[sim_pid] = 0;
+	queue_insert(&mlfq_queues[0], sim_pid);
+}
+
+static int mlfq_next() {
+	// Periodically boost everything to the top so low levels do not starve
+	if (++mlfq_turns >= MLFQ_BOOST_TURNS) {
+		mlfq_turns = 0;
+		for (int i = 1; i < MLFQ_LEVELS; i++) {
+			int sim_pid;
+			while ((sim_pid = queue_pop(&mlfq_queues[i])) >= 0) {
+				mlfq_level[sim_pid] = 0;
+				queue_insert(&mlfq_queues[0], sim_pid);
+			}
+		}
+	}
+
+	for (int i = 0; i < MLFQ_LEVELS; i++) {
+		if (!queue_is_empty(&mlfq_queues[i])) return queue_pop(&mlfq_queues[i]);
+	}
+	return -1;
+}
+
+static void mlfq_requeue(int sim_pid, int outcome) {
+	if (outcome == TURN_DENIED && mlfq_level[sim_pid] < MLFQ_LEVELS - 1) {
+		mlfq_level[sim_pid]++;
+	}
+	else if (outcome != TURN_DENIED && mlfq_level[sim_pid] > 0) {
+		mlfq_level[sim_pid]--;
+	}
+	queue_insert(&mlfq_queues[mlfq_level[sim_pid]], sim_pid);
+}
+
+static void mlfq_remove(int sim_pid) {
+	queue_remove(&mlfq_queues[mlfq_level[sim_pid]], sim_pid);
+}
+
+static size_t mlfq_ready() {
+	size_t size = 0;
+	for (int i = 0; i < MLFQ_LEVELS; i++) {
+		size += mlfq_queues[i].size;
+	}
+	return size;
+}
+
+static const struct sched_policy policies[] = {
+	{"rr", rr_init, rr_free, rr_add, rr_next, rr_requeue, rr_remove, rr_ready},
+	{"mlfq", mlfq_init, mlfq_free, mlfq_add, mlfq_next, mlfq_requeue, mlfq_remove, mlfq_ready},
+};
+
+// Public function to pick the policy by name. With wait_queue set, a denied process is
+// parked until a release or termination frees what it asked for. Returns false on unknown name.
+bool sched_init(const char* name, int max_procs, int num_res, bool wait_queue) {
+	policy = NULL;
+	for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+		if (strcmp(policies[i].name, name) == 0) policy = &policies[i];
+	}
+	if (policy == NULL) return false;
+
+	policy->init(max_procs);
+	use_wait_queue = wait_queue;
+	num_resources = num_res;
+	queue_init(&blocked, max_procs);
+	requests = calloc((size_t)max_procs * num_res, sizeof(int16_t));
+	return true;
+}
+
+void sched_free() {
+	if (policy == NULL) return;
+	policy->free();
+	queue_free(&blocked);
+	free(requests);
+	requests = NULL;
+	policy = NULL;
+}
+
+const char* sched_name() {
+	return policy != NULL ? policy->name : "none";
+}
+
+// Public function to make a newly spawned process ready
+void sched_add(int sim_pid) {
+	policy->add(sim_pid);
+}
+
+// Public function to take the next ready process to dispatch. Returns -1 if none are ready.
+int sched_next() {
+	return policy->next();
+}
+
+// Public function to hand a process back after its turn. Terminated processes leave the
+// scheduler, parked ones are held by the OSS wait lists until granted, and denied ones
+// wait on the blocked queue when it is enabled.
+void sched_finish(int sim_pid, int outcome) {
+	if (outcome == TURN_TERMINATED || outcome == TURN_PARKED) return;
+	if (outcome == TURN_DENIED && use_wait_queue) {
+		queue_insert(&blocked, sim_pid);
+		return;
+	}
+	policy->requeue(sim_pid, outcome);
+}
+
+// Public function to drop a process that is not running from the ready and blocked queues,
+// e.g. because it exited outside its turn
+void sched_remove(int sim_pid) {
+	if (!queue_remove(&blocked, sim_pid)) policy->remove(sim_pid);
+}
+
+// Public function to remember what a process last asked for, so its wake-up can be
+// checked against availability. Only the thread serving sim_pid writes its row.
+void sched_set_request(int sim_pid, const int* request) {
+	int16_t* row = &requests[(size_t)sim_pid * num_resources];
+	for (int i = 0; i < num_resources; i++) {
+		row[i] = request[i];
+	}
+}
+
+// Private function to check a blocked process's last request against what is available
+static bool request_fits(int sim_pid, const int16_t* available) {
+	const int16_t* row = &requests[(size_t)sim_pid * num_resources];
+	for (int i = 0; i < num_resources; i++) {
+		if (row[i] > available[i]) return false;
+	}
+	return true;
+}
+
+// Public function called after a release or termination. Wakes the blocked processes
+// whose last request now fits the available resources. Returns how many were woken and,
+// if woken is not NULL, writes their sim_pids to it.
+int sched_wake(const int16_t* available, int* woken_pids) {
+	int woken = 0;
+	int sim_pid = blocked.front_ind;
+	while (sim_pid >= 0) {
+		int next = blocked.next[sim_pid];
+		if (request_fits(sim_pid, available)) {
+			queue_remove(&blocked, sim_pid);
+			policy->requeue(sim_pid, TURN_DENIED);
+			if (woken_pids != NULL) woken_pids[woken] = sim_pid;
+			woken++;
+		}
+		sim_pid = next;
+	}
+	return woken;
+}
+
+// Public function to wake every blocked process. Used when nothing is left running
+// that could release resources, so the blocked processes retry instead of stalling.
+int sched_wake_all(int* woken_pids) {
+	int woken = 0;
+	int sim_pid;
+	while ((sim_pid = queue_pop(&blocked)) >= 0) {
+		policy->requeue(sim_pid, TURN_DENIED);
+		if (woken_pids != NULL) woken_pids[woken] = sim_pid;
+		woken++;
+	}
+	return woken;
+}
+
+size_t sched_ready() {
+	return policy->ready();
+}
+
+size_t sched_blocked() {
+	return blocked.size;
+}
@@ -0,0 +1,41 @@
+#ifndef __SCHED_H
+#define __SCHED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// How a process's scheduling turn ended
+enum Turn_Outcomes {TURN_GRANTED, TURN_DENIED, TURN_RELEASED, TURN_TERMINATED, TURN_PARKED};
+
+// Multi-level feedback queue tuning
+#define MLFQ_LEVELS 3
+#define MLFQ_BOOST_TURNS 100 // Move everything back to the top level every this many turns
+
+// A ready-queue policy. The blocked-on-resource wait queue sits in front of
+// every policy (see sched_finish()), so policies only order ready processes.
+struct sched_policy {
+    const char* name;
+    void (*init)(int max_procs);
+    void (*free)();
+    void (*add)(int sim_pid);
+    int (*next)();
+    void (*requeue)(int sim_pid, int outcome);
+    void (*remove)(int sim_pid);
+    size_t (*ready)();
+};
+
+bool sched_init(const char* policy, int max_procs, int num_res, bool wait_queue);
+void sched_free();
+const char* sched_name();
+void sched_add(int sim_pid);
+int sched_next();
+void sched_finish(int sim_pid, int outcome);
+void sched_remove(int sim_pid);
+void sched_set_request(int sim_pid, const int* requests);
+int sched_wake(const int16_t* available, int* woken);
+int sched_wake_all(int* woken);
+size_t sched_ready();
+size_t sched_blocked();
+
+#endif
@@ -0,0 +1,245 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <wait.h>
+#include <sys/prctl.h>
+
+#include "shard.h"
+#include "banker.h"
+#include "ring.h"
+
+static struct oss_shm* shared = NULL;
+static int num_shards = 0;
+static pid_t shard_pids[SHARDS_LIMIT];
+static pthread_mutex_t shard_locks[SHARDS_LIMIT];
+static struct shard_stats stats;
+
+// Private function to get the number of resources striped onto shard
+static int shard_res(int shard) {
+	return (shared->config.resources - shard + num_shards - 1) / num_shards;
+}
+
+// Private function to build a shard's allocator, laid out like the oss segment but
+// over only its own resources so the banker functions work on it unchanged
+static struct oss_shm* build_state(int shard) {
+	struct oss_config config = shared->config;
+	config.resources = shard_res(shard);
+	config.shards = 0;
+	size_t size = oss_shm_size(&config);
+	struct oss_shm* state = aligned_alloc(CACHE_LINE, size);
+	if (state == NULL) return NULL;
+	memset(state, 0, size);
+	oss_shm_layout(state, &config);
+	for (int j = 0; j < config.resources; j++) {
+		shm_descr(state, j)->resource = shm_descr(shared, shard + j * num_shards)->resource;
+		shm_descr(state, j)->is_shared = shm_descr(shared, shard + j * num_shards)->is_shared;
+	}
+	banker_init(state);
+	return state;
+}
+
+// Private function run by each shard process until told to exit
+static void serve(int shard, struct oss_shm* state) {
+	struct proc_channel* channel = shm_shard(shared, shard);
+	int num_res = state->config.resources;
+	int vector[num_res];
+	struct message msg;
+
+	while (ring_pop(&channel->to_proc, &msg, true)) {
+		int sim_pid = msg.sim_pid;
+		for (int j = 0; j < msg.num_res && j < num_res; j++) {
+			vector[j] = msg.resources[j];
+		}
+
+		switch (msg.opcode) {
+			case MSG_SHARD_ADMIT:
+				for (int j = 0; j < num_res; j++) {
+					pcb_max_res(state, sim_pid)[j] = vector[j];
+				}
+				banker_admit(state, sim_pid);
+				break;
+			case MSG_SHARD_RESERVE: {
+				// A reservation is held exactly like a grant until the coordinator aborts it
+				bool safe = banker_check(state, sim_pid, vector);
+				if (safe) banker_grant(state, sim_pid, vector);
+				msg_init(&msg, 0, safe ? MSG_ACQUIRED : MSG_DENIED, sim_pid);
+				ring_push(&channel->to_oss, &msg, true);
+				break;
+			}
+			case MSG_SHARD_ABORT:
+				banker_return(state, sim_pid, vector);
+				break;
+			case MSG_SHARD_RELEASE:
+				banker_release(state, sim_pid);
+				break;
+			case MSG_SHARD_REMOVE:
+				banker_remove(state, sim_pid);
+				break;
+			case MSG_EXIT:
+				return;
+		}
+	}
+}
+
+// Private function to send one operation to a shard with its slice of vector.
+// The caller holds the shard's lock, since the ring only takes one producer.
+static void send_op(int shard, int opcode, int sim_pid, const int* vector) {
+	struct message msg;
+	msg_init(&msg, 0, opcode, sim_pid);
+	if (vector != NULL) {
+		msg.num_res = shard_res(shard);
+		for (int j = 0; j < msg.num_res; j++) {
+			msg.resources[j] = vector[shard + j * num_shards];
+		}
+	}
+	ring_push(&shm_shard(shared, shard)->to_proc, &msg, true);
+}
+
+// Private function to send the same operation to every shard
+static void broadcast(int opcode, int sim_pid, const int* vector) {
+	for (int s = 0; s < num_shards; s++) {
+		pthread_mutex_lock(&shard_locks[s]);
+		send_op(s, opcode, sim_pid, vector);
+		pthread_mutex_unlock(&shard_locks[s]);
+	}
+}
+
+// Public function to fork one process per shard over shm->config.shards. Returns false
+// if a shard could not be started. Must be called before oss starts its own threads' work.
+bool shard_start(struct oss_shm* shm) {
+	shared = shm;
+	num_shards = shm->config.shards;
+	memset(&stats, 0, sizeof(stats));
+
+	// Build every shard's state before forking so the shards never allocate
+	struct oss_shm* states[num_shards];
+	for (int s = 0; s < num_shards; s++) {
+		states[s] = build_state(s);
+		if (states[s] == NULL) {
+			perror("Could not allocate shard state");
+			return false;
+		}
+		pthread_mutex_init(&shard_locks[s], NULL);
+		ring_init(&shm_shard(shm, s)->to_oss);
+		ring_init(&shm_shard(shm, s)->to_proc);
+	}
+
+	for (int s = 0; s < num_shards; s++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			// oss cleans up on SIGINT and kills us; die with it if it goes first
+			signal(SIGINT, SIG_IGN);
+			signal(SIGUSR1, SIG_IGN);
+			prctl(PR_SET_PDEATHSIG, SIGKILL);
+			serve(s, states[s]);
+			_exit(EXIT_SUCCESS);
+		}
+		else if (pid < 0) {
+			perror("Could not fork shard");
+			return false;
+		}
+		shard_pids[s] = pid;
+	}
+
+	for (int s = 0; s < num_shards; s++) {
+		free(states[s]);
+	}
+	return true;
+}
+
+// Public function to tell every shard to exit and wait for them
+void shard_stop() {
+	broadcast(MSG_EXIT, 0, NULL);
+	for (int s = 0; s < num_shards; s++) {
+		if (shard_pids[s] > 0) waitpid(shard_pids[s], NULL, 0);
+		shard_pids[s] = 0;
+	}
+}
+
+// Public function to kill the shards without waiting. Used from the signal handler.
+void shard_kill() {
+	for (int s = 0; s < num_shards; s++) {
+		if (shard_pids[s] > 0) kill(shard_pids[s], SIGKILL);
+		shard_pids[s] = 0;
+	}
+}
+
+// Public function to hand every shard its slice of sim_pid's maximum claim
+void shard_admit(int sim_pid) {
+	int num_res = shared->config.resources;
+	int claim[num_res];
+	const int16_t* max_res = pcb_max_res(shared, sim_pid);
+	for (int j = 0; j < num_res; j++) {
+		claim[j] = max_res[j];
+	}
+	broadcast(MSG_SHARD_ADMIT, sim_pid, claim);
+}
+
+// Public function to decide a request. Returns true if every shard it touches accepted
+// its part, in which case the shards already hold it.
+bool shard_grant(int sim_pid, const int* requests) {
+	bool involved[num_shards];
+	bool accepted[num_shards];
+	int count = 0;
+	for (int s = 0; s < num_shards; s++) {
+		involved[s] = false;
+		for (int j = s; j < shared->config.resources; j += num_shards) {
+			if (requests[j] > 0) {
+				involved[s] = true;
+				count++;
+				break;
+			}
+		}
+	}
+	// Asking for nothing cannot make a safe state unsafe
+	if (count == 0) return true;
+
+	// Phase one: reserve on every shard involved. Locks are taken in shard order so
+	// two spanning requests can never each hold a shard the other is waiting on.
+	for (int s = 0; s < num_shards; s++) {
+		if (!involved[s]) continue;
+		pthread_mutex_lock(&shard_locks[s]);
+		send_op(s, MSG_SHARD_RESERVE, sim_pid, requests);
+	}
+	bool granted = true;
+	for (int s = 0; s < num_shards; s++) {
+		if (!involved[s]) continue;
+		struct message reply;
+		ring_pop(&shm_shard(shared, s)->to_oss, &reply, true);
+		accepted[s] = reply.opcode == MSG_ACQUIRED;
+		if (!accepted[s]) granted = false;
+		__atomic_add_fetch(&stats.decisions[s], 1, __ATOMIC_RELAXED);
+	}
+
+	// Phase two: keep the reservations, or hand back the ones that were made
+	for (int s = 0; s < num_shards; s++) {
+		if (!involved[s]) continue;
+		if (!granted && accepted[s]) send_op(s, MSG_SHARD_ABORT, sim_pid, requests);
+		pthread_mutex_unlock(&shard_locks[s]);
+	}
+
+	if (count == 1) {
+		__atomic_add_fetch(&stats.single, 1, __ATOMIC_RELAXED);
+	}
+	else {
+		__atomic_add_fetch(&stats.spanning, 1, __ATOMIC_RELAXED);
+		if (!granted) __atomic_add_fetch(&stats.aborts, 1, __ATOMIC_RELAXED);
+	}
+	return granted;
+}
+
+void shard_release(int sim_pid) {
+	broadcast(MSG_SHARD_RELEASE, sim_pid, NULL);
+}
+
+void shard_remove(int sim_pid) {
+	broadcast(MSG_SHARD_REMOVE, sim_pid, NULL);
+}
+
+void shard_get_stats(struct shard_stats* out) {
+	*out = stats;
+}
@@ -0,0 +1,32 @@
+#ifndef __SHARD_H
+#define __SHARD_H
+
+#include <stdbool.h>
+
+#include "shared.h"
+#include "config.h"
+
+// Sharded allocation (-o shards=N). Resources are striped across N shard
+// processes, resource j living on shard j % N, and each shard keeps the
+// Banker's state for its own resources and runs the safety check on them.
+// oss coordinates over a ring pair per shard in shared memory. A request that
+// touches one shard is decided by that shard alone. One that spans shards is
+// reserved on every shard involved, then kept if all of them accept it or
+// handed back if any refuses, so no request ever holds part of its resources.
+struct shard_stats {
+    unsigned long single;
+    unsigned long spanning;
+    unsigned long aborts;
+    unsigned long decisions[SHARDS_LIMIT];
+};
+
+bool shard_start(struct oss_shm* shm);
+void shard_stop();
+void shard_kill();
+void shard_admit(int sim_pid);
+bool shard_grant(int sim_pid, const int* requests);
+void shard_release(int sim_pid);
+void shard_remove(int sim_pid);
+void shard_get_stats(struct shard_stats* stats);
+
+#endif
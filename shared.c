@@ -15,17 +15,216 @@ struct oss_shm* shared_mem = NULL;
 static int semaphore_id = -1;
 static int oss_msg_queue;
 static int proc_msg_queue;
+static int doorbell_fd = -1;
 
 // Private function to get shared memory key
-int get_shm(int token) {
+// Pass size = 0 to attach to an existing segment of any size
+int get_shm(int token, size_t size) {
 	key_t key;
 
 	// Get numeric key of shared memory file
 	key = ftok(SHM_FILE, token);
 	if (key == -1) return -1;
 
+	if (size == 0) return shmget(key, 0, 0644);
+
 	// Get shared memory id from the key
-	return shmget(key, sizeof(struct oss_shm), 0644 | IPC_CREAT);
+	int mem_id = shmget(key, size, 0644 | IPC_CREAT);
+	if (mem_id < 0 && errno == EINVAL) {
+		// A leftover segment from an earlier run is too small, replace it
+		mem_id = shmget(key, 0, 0644);
+		if (mem_id >= 0) shmctl(mem_id, IPC_RMID, NULL);
+		mem_id = shmget(key, size, 0644 | IPC_CREAT);
+	}
+	return mem_id;
+}
+
+// Private function to round size up to a multiple of align
+static size_t round_up(size_t size, size_t align) {
+	return (size + align - 1) / align * align;
+}
+
+// Public function to fill config with the defaults from config.h
+void config_defaults(struct oss_config* config) {
+	config->processes = MAX_PROCESSES;
+	config->resources = MAX_RES_INSTANCES;
+	config->run_procs = MAX_RUN_PROCS;
+	config->runtime = MAX_RUNTIME;
+	config->min_spawn_secs = minTimeBetweenNewProcsSecs;
+	config->max_spawn_secs = maxTimeBetweenNewProcsSecs;
+	config->min_spawn_ns = minTimeBetweenNewProcsNS;
+	config->max_spawn_ns = maxTimeBetweenNewProcsNS;
+	config->stats_secs = STATS_INTERVAL_SECS;
+	config->detect_secs = DETECT_INTERVAL_SECS;
+	config->request_dist = DIST_UNIFORM;
+	config->shards = 0;
+	config->shared_pct = SHARED_RES_PCT;
+	config->batch = BATCH_OPS;
+}
+
+// Public function to set a single config value by name. Returns false on unknown key.
+bool config_set(struct oss_config* config, const char* key, const char* value) {
+	// The one setting that takes a name rather than a number
+	if (strcmp(key, "request_dist") == 0) {
+		if (strcmp(value, "uniform") == 0) config->request_dist = DIST_UNIFORM;
+		else if (strcmp(value, "zipf") == 0) config->request_dist = DIST_ZIPF;
+		else if (strcmp(value, "bursty") == 0) config->request_dist = DIST_BURSTY;
+		else {
+			fprintf(stderr, "Invalid value '%s' for %s, expected uniform, zipf or bursty\n", value, key);
+			return false;
+		}
+		return true;
+	}
+
+	char* end;
+	long number = strtol(value, &end, 10);
+	if (*value == '\0' || *end != '\0' || number < 0) {
+		fprintf(stderr, "Invalid value '%s' for %s\n", value, key);
+		return false;
+	}
+
+	if (strcmp(key, "processes") == 0) config->processes = number;
+	else if (strcmp(key, "resources") == 0) config->resources = number;
+	else if (strcmp(key, "run_procs") == 0) config->run_procs = number;
+	else if (strcmp(key, "runtime") == 0) config->runtime = number;
+	else if (strcmp(key, "min_spawn_secs") == 0) config->min_spawn_secs = number;
+	else if (strcmp(key, "max_spawn_secs") == 0) config->max_spawn_secs = number;
+	else if (strcmp(key, "min_spawn_ns") == 0) config->min_spawn_ns = number;
+	else if (strcmp(key, "max_spawn_ns") == 0) config->max_spawn_ns = number;
+	else if (strcmp(key, "stats_secs") == 0) config->stats_secs = number;
+	else if (strcmp(key, "detect_secs") == 0) config->detect_secs = number;
+	else if (strcmp(key, "shards") == 0) config->shards = number;
+	else if (strcmp(key, "shared_pct") == 0) config->shared_pct = number;
+	else if (strcmp(key, "batch") == 0) config->batch = number;
+	else {
+		fprintf(stderr, "Unknown config key '%s'\n", key);
+		return false;
+	}
+	return true;
+}
+
+// Public function to apply a "key = value" line. Blank lines and # comments are ignored.
+bool config_parse(struct oss_config* config, const char* line) {
+	char key[64];
+	char value[64];
+	char buf[256];
+	strncpy(buf, line, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+
+	// Strip comments
+	char* comment = strchr(buf, '#');
+	if (comment != NULL) *comment = '\0';
+
+	// Treat '=' as whitespace so "key=value" and "key = value" both parse
+	for (char* c = buf; *c; c++) {
+		if (*c == '=') *c = ' ';
+	}
+
+	int matched = sscanf(buf, "%63s %63s", key, value);
+	if (matched <= 0) return true;
+	if (matched != 2) {
+		fprintf(stderr, "Malformed config line '%s'\n", line);
+		return false;
+	}
+	return config_set(config, key, value);
+}
+
+// Public function to apply every line of a config file
+bool config_load(struct oss_config* config, const char* path) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		perror("Could not open config file");
+		return false;
+	}
+
+	char line[256];
+	bool ok = true;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		line[strcspn(line, "\n")] = '\0';
+		if (!config_parse(config, line)) ok = false;
+	}
+	fclose(file);
+	return ok;
+}
+
+// Public function to check the config is within the hard limits
+bool config_validate(const struct oss_config* config) {
+	if (config->processes < 1 || config->processes > PROCESSES_LIMIT) {
+		fprintf(stderr, "processes must be between 1 and %d\n", PROCESSES_LIMIT);
+		return false;
+	}
+	if (config->resources < 1 || config->resources > RESOURCES_LIMIT) {
+		fprintf(stderr, "resources must be between 1 and %d\n", RESOURCES_LIMIT);
+		return false;
+	}
+	if (config->runtime < 1) {
+		fprintf(stderr, "runtime must be at least 1 second\n");
+		return false;
+	}
+	if (config->stats_secs < 1) {
+		fprintf(stderr, "stats_secs must be at least 1 second\n");
+		return false;
+	}
+	if (config->detect_secs < 1) {
+		fprintf(stderr, "detect_secs must be at least 1 second\n");
+		return false;
+	}
+	if (config->shared_pct > 100) {
+		fprintf(stderr, "shared_pct must be between 0 and 100\n");
+		return false;
+	}
+	if (config->shards > SHARDS_LIMIT || config->shards > config->resources) {
+		fprintf(stderr, "shards must be at most %d and at most the number of resources\n", SHARDS_LIMIT);
+		return false;
+	}
+	// A full batch is one opcode plus one resource vector per operation
+	if (config->batch < 1 || config->batch > BATCH_LIMIT || config->batch * (config->resources + 1) > RESOURCES_LIMIT) {
+		fprintf(stderr, "batch must be between 1 and %d, and batch * (resources + 1) at most %d\n", BATCH_LIMIT, RESOURCES_LIMIT);
+		return false;
+	}
+	if (config->min_spawn_secs > config->max_spawn_secs || config->min_spawn_ns > config->max_spawn_ns) {
+		fprintf(stderr, "minimum spawn interval must not exceed the maximum\n");
+		return false;
+	}
+	return true;
+}
+
+// Public function to get the size of the shared memory segment for config
+size_t oss_shm_size(const struct oss_config* config) {
+	size_t res_stride = round_up(config->resources * sizeof(int16_t), CACHE_LINE);
+	size_t size = round_up(sizeof(struct oss_shm), CACHE_LINE);
+	size += round_up(config->processes * sizeof(struct proc_channel), CACHE_LINE);
+	size += config->processes * sizeof(struct process_ctrl_block);
+	size += 2 * config->processes * res_stride;
+	size += round_up(config->resources * sizeof(struct res_descr), CACHE_LINE);
+	size += round_up(banker_size(config->processes, config->resources), CACHE_LINE);
+	size += round_up(metrics_size(config->resources), CACHE_LINE);
+	size += config->shards * sizeof(struct proc_channel);
+	return size;
+}
+
+// Public function to lay out the regions that follow the header of shm
+void oss_shm_layout(struct oss_shm* shm, const struct oss_config* config) {
+	shm->config = *config;
+	shm->size = oss_shm_size(config);
+	shm->res_stride = round_up(config->resources * sizeof(int16_t), CACHE_LINE);
+
+	size_t offset = round_up(sizeof(struct oss_shm), CACHE_LINE);
+	shm->channels_off = offset;
+	offset += round_up(config->processes * sizeof(struct proc_channel), CACHE_LINE);
+	shm->table_off = offset;
+	offset += config->processes * sizeof(struct process_ctrl_block);
+	shm->max_res_off = offset;
+	offset += config->processes * shm->res_stride;
+	shm->allow_res_off = offset;
+	offset += config->processes * shm->res_stride;
+	shm->descriptors_off = offset;
+	offset += round_up(config->resources * sizeof(struct res_descr), CACHE_LINE);
+	shm->banker_off = offset;
+	offset += round_up(banker_size(config->processes, config->resources), CACHE_LINE);
+	shm->metrics_off = offset;
+	offset += round_up(metrics_size(config->resources), CACHE_LINE);
+	shm->shards_off = offset;
 }
 
 // private function to get the specified number of semaphores from id
@@ -64,13 +263,13 @@ void unlock(int num) {
 } 
 
 // Public function to initalize the oss shared resources
-// Pass create = true for intializalizing values
-void init_oss(bool create) {
+// Pass create = true and a config for sizing and intializalizing values
+void init_oss(bool create, const struct oss_config* config) {
 	// Get semaphores
 	getsemaphores(OSS_SEM, FINAL_SEMIDS_SIZE); 
 
 	// Get shared memory
-    int mem_id = get_shm(OSS_SHM);
+    int mem_id = get_shm(OSS_SHM, create ? oss_shm_size(config) : 0);
     if (mem_id < 0) {
         printf("Could not get shared memory file.");
     }
@@ -104,18 +303,31 @@ void init_oss(bool create) {
 	if (!create) return;
 	
 	// Setup system clock
-	shared_mem->sys_clock.semaphore_id = SYSCLK_SEM;
-	shared_mem->sys_clock.seconds = 0;
-	shared_mem->sys_clock.nanoseconds = 0;
+	clock_set(&shared_mem->sys_clock, 0);
+
+	// Size the process table, descriptors and banker state from config
+	oss_shm_layout(shared_mem, config);
+	memset((char*)shared_mem + shared_mem->channels_off, 0, shared_mem->size - shared_mem->channels_off);
+
+	// Default to message queues and empty all ring channels
+	shared_mem->transport = TRANSPORT_MSGQ;
+	for (int i = 0; i < config->processes; i++) {
+		ring_init(&shm_channel(shared_mem, i)->to_oss);
+		ring_init(&shm_channel(shared_mem, i)->to_proc);
+	}
 
 	// Intialize resource descriptors
-	for (int i = 0; i < MAX_RES_INSTANCES; i++) {
+	for (int i = 0; i < config->resources; i++) {
 		// random resource num between 1-10
-		shared_mem->descriptors[i].resource = (rand() % 10) + 1;
-		// 20% chance for resource to be shared
-		shared_mem->descriptors[i].is_shared = (rand() % 20) > 20 ? false : true; 
+		shm_descr(shared_mem, i)->resource = (rand() % 10) + 1;
+		// shared_pct% chance for resource to be shared
+		shm_descr(shared_mem, i)->is_shared = (rand() % 100) < config->shared_pct;
 	}
 
+	// Everything is available until processes are admitted
+	banker_init(shared_mem);
+	metrics_init(shm_metrics(shared_mem), config->resources);
+
 	// Intialize semaphores w/ initial value of 1
 	union semun arg;
 	arg.val = 1;
@@ -126,6 +338,16 @@ void init_oss(bool create) {
 	}
 }
 
+// Public function for monitors to attach to a running oss's shared memory without
+// being able to write to it. Returns NULL if oss is not running.
+struct oss_shm* attach_oss_readonly() {
+	int mem_id = get_shm(OSS_SHM, 0);
+	if (mem_id < 0) return NULL;
+	void* shm = shmat(mem_id, NULL, SHM_RDONLY);
+	if (shm == (void*)-1) return NULL;
+	return shm;
+}
+
 // Public function to destruct oss shared resources
 void dest_oss() {
 	// remove semaphores
@@ -134,7 +356,7 @@ void dest_oss() {
 	}
 
 	// Remove shared memory
-	int mem_id = get_shm(OSS_SHM);
+	int mem_id = get_shm(OSS_SHM, 0);
 	if (mem_id < 0) {
         perror("Could not get shared memory file");
     }
@@ -155,56 +377,82 @@ void dest_oss() {
 
 // Public function to add time to clock
 void add_time(struct time_clock* Time, unsigned long seconds, unsigned long nanoseconds) {
-	// Lock if managed by a semaphore
-	if (Time->semaphore_id > 0) lock(Time->semaphore_id);
-	Time->seconds += seconds;
-	Time->nanoseconds += nanoseconds;
-	if (Time->nanoseconds > 1000000000)
-	{
-		Time->seconds += 1;
-		Time->nanoseconds -= 1000000000;
-	}
-
-	// unlock if managed by a semaphore
-	if (Time->semaphore_id > 0) unlock(Time->semaphore_id);
-}
-
-// Private function to subtract time from clock
-bool __sub_time(struct time_clock* Time, unsigned long seconds, unsigned long nanoseconds) {
-	// If subtracting more nanoseconds then is on the clock
-	if (nanoseconds > Time->nanoseconds) {
-		// See if we can borrow a second
-		if (Time->seconds < 1) return false;
-		// Borrow a second
-		Time->nanoseconds += 1000000000;
-		Time->seconds -= 1;
-	}
-	// Subtract the nanoseconds
-	Time->nanoseconds -= nanoseconds;
-
-	// If subtracting more seconds than we have on clock
-	if (seconds > Time->seconds) {
-		// Add back the nanoseconds we took
-		add_time(Time, 0, nanoseconds);
-		return false;
-	}
-	// Subtract the seconds
-	Time->seconds -= seconds;
-	return true;
+	__atomic_add_fetch(&Time->ns, seconds * NS_PER_SEC + nanoseconds, __ATOMIC_RELEASE);
 }
 
 // public interface function to subtract time from clock
 void sub_time(struct time_clock* Time, unsigned long seconds, unsigned long nanoseconds) {
-	// Lock if managed by a semaphore
-	if (Time->semaphore_id > 0) lock(Time->semaphore_id);
-	if (!__sub_time(Time, seconds, nanoseconds)) {
-		perror("Could not subtract time.");
+	uint64_t amount = seconds * NS_PER_SEC + nanoseconds;
+	uint64_t current = __atomic_load_n(&Time->ns, __ATOMIC_ACQUIRE);
+	do {
+		// Never let the clock go below zero
+		if (amount > current) {
+			errno = EINVAL;
+			perror("Could not subtract time.");
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&Time->ns, &current, current - amount, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+}
+
+// Public function to get the time on the clock in nanoseconds
+uint64_t clock_now(const struct time_clock* Time) {
+	return __atomic_load_n(&Time->ns, __ATOMIC_ACQUIRE);
+}
+
+// Public function to set the time on the clock in nanoseconds
+void clock_set(struct time_clock* Time, uint64_t ns) {
+	__atomic_store_n(&Time->ns, ns, __ATOMIC_RELEASE);
+}
+
+// Public function to get the clock as seconds and nanoseconds from one consistent read
+void clock_read(const struct time_clock* Time, unsigned long* seconds, unsigned long* nanoseconds) {
+	uint64_t now = clock_now(Time);
+	*seconds = now / NS_PER_SEC;
+	*nanoseconds = now % NS_PER_SEC;
+}
+
+// Public function to setup a message header
+void msg_init(struct message* msg, long int msg_type, int opcode, int sim_pid) {
+	msg->msg_type = msg_type;
+	msg->version = MSG_VERSION;
+	msg->opcode = (uint8_t)opcode;
+	msg->sim_pid = (int16_t)sim_pid;
+	msg->num_res = 0;
+	msg->num_ops = 0;
+}
+
+// Public function to get the number of payload bytes (excluding msg_type) a message holds
+size_t msg_size(const struct message* msg) {
+	size_t header = offsetof(struct message, resources) - sizeof(long int);
+	if (msg->opcode == MSG_REQUEST || msg->opcode == MSG_BATCH || msg->opcode == MSG_RESULTS) {
+		return header + msg->num_res * sizeof(msg->resources[0]);
+	}
+	return header;
+}
+
+// Private function to get the ring a message travels on in ring transport mode
+struct msg_ring* get_ring(struct message* msg, int msg_queue) {
+	if (msg->sim_pid < 0 || msg->sim_pid >= shared_mem->config.processes) {
+		printf("Got unexpected sim_pid of %d\n", msg->sim_pid);
+		return NULL;
 	}
-	// unlock if managed by a semaphore
-	if (Time->semaphore_id > 0) unlock(Time->semaphore_id);
+	if (msg_queue == OSS_MSG) {
+		return &shm_channel(shared_mem, msg->sim_pid)->to_oss;
+	}
+	else if (msg_queue == PROC_MSG) {
+		return &shm_channel(shared_mem, msg->sim_pid)->to_proc;
+	}
+	printf("Got unexpected message queue ID of %d\n", msg_queue);
+	return NULL;
 }
 
-void recieve_msg(struct message* msg, int msg_queue, bool wait) {
+// Returns false if no message was taken, e.g. none was waiting and wait is false
+bool recieve_msg(struct message* msg, int msg_queue, bool wait) {
+	if (shared_mem->transport == TRANSPORT_RING) {
+		struct msg_ring* ring = get_ring(msg, msg_queue);
+		return ring != NULL && ring_pop(ring, msg, wait);
+	}
+
 	int msg_queue_id;
 	if (msg_queue == OSS_MSG) {
 		msg_queue_id = oss_msg_queue;
@@ -214,14 +462,48 @@ void recieve_msg(struct message* msg, int msg_queue, bool wait) {
 	}
 	else {
 		printf("Got unexpected message queue ID of %d\n", msg_queue);
+		return false;
 	}
-	if (msgrcv(msg_queue_id, msg, sizeof(struct message), msg->msg_type, wait ? 0 : IPC_NOWAIT) < 0) {
+	if (msgrcv(msg_queue_id, msg, sizeof(struct message) - sizeof(long int), msg->msg_type, wait ? 0 : IPC_NOWAIT) < 0) {
+		if (!wait && errno == ENOMSG) return false;
 		perror("Could not recieve message");
-		fprintf(stderr, "msg: %s type: %ld queue: %d wait?: %d\n", msg->msg_text, msg->msg_type, msg_queue_id, wait);
+		fprintf(stderr, "opcode: %d type: %ld queue: %d wait?: %d\n", msg->opcode, msg->msg_type, msg_queue_id, wait);
+		return false;
+	}
+	if (msg->version != MSG_VERSION) {
+		fprintf(stderr, "Got message version %d, expected %d\n", msg->version, MSG_VERSION);
 	}
+	return true;
+}
+
+// Private function to wake oss after a message to it, if it is waiting on our reply
+static void ring_doorbell(const struct message* msg) {
+	if (doorbell_fd < 0) return;
+	struct process_ctrl_block* pcb = shm_pcb(shared_mem, msg->sim_pid);
+	// Pairs with oss setting oss_waiting before it checks for the reply
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&pcb->oss_waiting, __ATOMIC_SEQ_CST)) return;
+	uint64_t one = 1;
+	if (write(doorbell_fd, &one, sizeof(one)) < 0) perror("Could not ring doorbell");
+}
+
+// Public function for children to set the eventfd they ring after messaging oss
+void set_doorbell(int fd) {
+	doorbell_fd = fd;
 }
 
 void send_msg(struct message* msg, int msg_queue, bool wait) {
+	if (shared_mem->transport == TRANSPORT_RING) {
+		struct msg_ring* ring = get_ring(msg, msg_queue);
+		if (ring == NULL) return;
+		if (!ring_push(ring, msg, wait)) {
+			fprintf(stderr, "Could not send message: ring for P%d full\n", msg->sim_pid);
+			return;
+		}
+		if (msg_queue == OSS_MSG) ring_doorbell(msg);
+		return;
+	}
+
 	int msg_queue_id;
 	if (msg_queue == OSS_MSG) {
 		msg_queue_id = oss_msg_queue;
@@ -231,9 +513,12 @@ void send_msg(struct message* msg, int msg_queue, bool wait) {
 	}
 	else {
 		printf("Got unexpected message queue ID of %d\n", msg_queue);
+		return;
 	}
-	if (msgsnd(msg_queue_id, msg, sizeof(struct message), wait ? 0 : IPC_NOWAIT) < 0) {
+	if (msgsnd(msg_queue_id, msg, msg_size(msg), wait ? 0 : IPC_NOWAIT) < 0) {
 		perror("Could not send message");
-		fprintf(stderr, "msg: %s type: %ld queue: %d wait?: %d\n", msg->msg_text, msg->msg_type, msg_queue_id, wait);
+		fprintf(stderr, "opcode: %d type: %ld queue: %d wait?: %d\n", msg->opcode, msg->msg_type, msg_queue_id, wait);
+		return;
 	}
-}
\ No newline at end of file
+	if (msg_queue == OSS_MSG) ring_doorbell(msg);
+}
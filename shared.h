@@ -2,10 +2,18 @@
 #define __SHARED_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
 #include "config.h"
+#include "message.h"
+#include "ring.h"
+#include "banker.h"
+#include "metrics.h"
 
 enum Shared_Mem_Tokens {OSS_SHM, OSS_SEM, OSS_MSG, PROC_MSG};
 enum Semaphore_Ids {BEGIN_SEMIDS, SYSCLK_SEM, FINAL_SEMIDS_SIZE};
+enum Transports {TRANSPORT_MSGQ, TRANSPORT_RING};
 
 union semun {
     int val;
@@ -13,15 +21,32 @@ union semun {
     unsigned short* array;
 };
 
+#define NS_PER_SEC 1000000000ULL
+
+// Simulated clock as a single nanosecond counter. Updated with an atomic add
+// and read with a single atomic load, so readers never see a torn value.
 struct time_clock {
-    unsigned long nanoseconds;
-    unsigned long seconds; 
-    int semaphore_id;
+    uint64_t ns;
 };
 
-struct message {
-    long int msg_type;
-    char msg_text[MSG_BUFFER_LEN];
+enum Request_Dists {DIST_UNIFORM, DIST_ZIPF, DIST_BURSTY};
+
+// Runtime limits. Defaults come from config.h.
+struct oss_config {
+    int processes;
+    int resources;
+    int run_procs;
+    int runtime;
+    unsigned long min_spawn_secs;
+    unsigned long max_spawn_secs;
+    unsigned long min_spawn_ns;
+    unsigned long max_spawn_ns;
+    unsigned long stats_secs;
+    unsigned long detect_secs;
+    int request_dist;
+    int shards;
+    int shared_pct;
+    int batch;
 };
 
 struct res_descr {
@@ -29,25 +54,94 @@ struct res_descr {
     bool is_shared;
 };
 
+// One slot of the process table, padded to its own cache line. The slot's
+// max_res and allow_res rows live in separate tables (see pcb_max_res).
+// spawn_ns and spawn_seq are set before the process starts so it can derive
+// its lifetime and, in seeded runs, its random stream without racing oss.
+// oss_waiting is set while oss waits on a reply, so the child knows to ring.
 struct process_ctrl_block {
     unsigned int sim_pid;
     pid_t actual_pid;
-    int max_res[MAX_RES_INSTANCES];
-    int allow_res[MAX_RES_INSTANCES];
-};
+    uint64_t spawn_ns;
+    unsigned int spawn_seq;
+    uint32_t oss_waiting;
+} __attribute__((aligned(CACHE_LINE)));
 
+// Header of the shared memory segment. The ring channels, process table,
+// max_res and allow_res tables, resource descriptors, banker state and metrics
+// page follow it at the given offsets and are sized from config when oss
+// creates the segment. Each max_res and allow_res row takes res_stride bytes,
+// a whole number of cache lines.
 struct oss_shm {
     struct time_clock sys_clock;
-    struct process_ctrl_block process_table[MAX_PROCESSES];
-    struct res_descr descriptors[MAX_RES_INSTANCES];
+    int transport;
+    struct oss_config config;
+    uint64_t seed;
+    bool seeded;
+    size_t size;
+    size_t res_stride;
+    size_t channels_off;
+    size_t table_off;
+    size_t max_res_off;
+    size_t allow_res_off;
+    size_t descriptors_off;
+    size_t banker_off;
+    size_t metrics_off;
+    size_t shards_off;
 };
 
+static inline struct proc_channel* shm_channel(struct oss_shm* shm, int sim_pid) {
+    return (struct proc_channel*)((char*)shm + shm->channels_off) + sim_pid;
+}
+
+static inline struct process_ctrl_block* shm_pcb(struct oss_shm* shm, int sim_pid) {
+    return (struct process_ctrl_block*)((char*)shm + shm->table_off) + sim_pid;
+}
+
+static inline int16_t* pcb_max_res(struct oss_shm* shm, int sim_pid) {
+    return (int16_t*)((char*)shm + shm->max_res_off + sim_pid * shm->res_stride);
+}
+
+static inline int16_t* pcb_allow_res(struct oss_shm* shm, int sim_pid) {
+    return (int16_t*)((char*)shm + shm->allow_res_off + sim_pid * shm->res_stride);
+}
+
+static inline struct res_descr* shm_descr(struct oss_shm* shm, int res) {
+    return (struct res_descr*)((char*)shm + shm->descriptors_off) + res;
+}
+
+static inline struct banker_state* shm_banker(struct oss_shm* shm) {
+    return (struct banker_state*)((char*)shm + shm->banker_off);
+}
+
+static inline struct proc_channel* shm_shard(struct oss_shm* shm, int shard) {
+    return (struct proc_channel*)((char*)shm + shm->shards_off) + shard;
+}
+
+static inline struct oss_metrics* shm_metrics(struct oss_shm* shm) {
+    return (struct oss_metrics*)((char*)shm + shm->metrics_off);
+}
+
+void config_defaults(struct oss_config* config);
+bool config_set(struct oss_config* config, const char* key, const char* value);
+bool config_parse(struct oss_config* config, const char* line);
+bool config_load(struct oss_config* config, const char* path);
+bool config_validate(const struct oss_config* config);
+size_t oss_shm_size(const struct oss_config* config);
+void oss_shm_layout(struct oss_shm* shm, const struct oss_config* config);
 void dest_oss();
-void init_oss(bool create);
+void init_oss(bool create, const struct oss_config* config);
+struct oss_shm* attach_oss_readonly();
 void add_time(struct time_clock* Time, unsigned long seconds, unsigned long nanoseconds);
 void sub_time(struct time_clock* Time, unsigned long seconds, unsigned long nanoseconds);
-void recieve_msg(struct message* msg, int msg_queue, bool wait);
+uint64_t clock_now(const struct time_clock* Time);
+void clock_set(struct time_clock* Time, uint64_t ns);
+void clock_read(const struct time_clock* Time, unsigned long* seconds, unsigned long* nanoseconds);
+void msg_init(struct message* msg, long int msg_type, int opcode, int sim_pid);
+size_t msg_size(const struct message* msg);
+bool recieve_msg(struct message* msg, int msg_queue, bool wait);
 void send_msg(struct message* msg, int msg_queue, bool wait);
+void set_doorbell(int fd);
 
 
 #endif
@@ -0,0 +1,91 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+#define TRACE_BUFFER_SIZE (1 << 20)
+
+static FILE* trace_file = NULL;
+static int trace_res = 0;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Public function to start recording to path. totals and shared describe the num_res resources
+// so a replay can rebuild the same system. Returns false if the file could not be created.
+bool trace_open(const char* path, int num_procs, int num_res, uint64_t seed, const int16_t* totals, const int16_t* shared) {
+	trace_file = fopen(path, "wb");
+	if (trace_file == NULL) {
+		perror("Could not open trace file");
+		return false;
+	}
+	setvbuf(trace_file, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+	trace_res = num_res;
+
+	struct trace_header header = {TRACE_MAGIC, TRACE_VERSION, 0, num_procs, num_res, seed};
+	fwrite(&header, sizeof(header), 1, trace_file);
+	fwrite(totals, sizeof(int16_t), num_res, trace_file);
+	fwrite(shared, sizeof(int16_t), num_res, trace_file);
+	return true;
+}
+
+bool trace_is_open() {
+	return trace_file != NULL;
+}
+
+// Public function to record one event. vector is the resource vector for ADMIT and REQUEST
+// and NULL for everything else. Safe to call from dispatcher threads.
+void trace_event(uint64_t time, int type, int sim_pid, const int* vector) {
+	if (!trace_is_open()) return;
+	struct trace_record record = {time, type, 0, sim_pid, vector != NULL ? trace_res : 0, 0};
+	int16_t values[trace_res];
+	for (int i = 0; vector != NULL && i < trace_res; i++) {
+		values[i] = vector[i];
+	}
+
+	// Check again under the lock, the trace may have been closed since
+	pthread_mutex_lock(&trace_lock);
+	if (trace_file != NULL) {
+		fwrite(&record, sizeof(record), 1, trace_file);
+		if (vector != NULL) fwrite(values, sizeof(int16_t), trace_res, trace_file);
+	}
+	pthread_mutex_unlock(&trace_lock);
+}
+
+// Public function to flush and close the trace. Must not be called from a signal handler,
+// as it takes the trace lock.
+void trace_close() {
+	pthread_mutex_lock(&trace_lock);
+	if (trace_file != NULL) {
+		fclose(trace_file);
+		trace_file = NULL;
+	}
+	pthread_mutex_unlock(&trace_lock);
+}
+
+// Public function to open a trace for replay. Reads the header and up to max_res totals.
+// Returns NULL if the file is missing, not a trace or has more resources than max_res.
+FILE* trace_read_open(const char* path, struct trace_header* header, int16_t* totals, int16_t* shared, int max_res) {
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		perror("Could not open trace file");
+		return NULL;
+	}
+	if (fread(header, sizeof(*header), 1, file) != 1 || header->magic != TRACE_MAGIC || header->version != TRACE_VERSION
+		|| header->num_res < 1 || header->num_res > max_res
+		|| fread(totals, sizeof(int16_t), header->num_res, file) != (size_t)header->num_res
+		|| fread(shared, sizeof(int16_t), header->num_res, file) != (size_t)header->num_res) {
+		fprintf(stderr, "%s is not a trace this build can replay\n", path);
+		fclose(file);
+		return NULL;
+	}
+	return file;
+}
+
+// Public function to read the next record and its vector, if any. Returns false at the end.
+bool trace_read(FILE* file, struct trace_record* record, int16_t* vector, int max_res) {
+	if (fread(record, sizeof(*record), 1, file) != 1) return false;
+	if (record->num_res > max_res) return false;
+	return fread(vector, sizeof(int16_t), record->num_res, file) == record->num_res;
+}
@@ -0,0 +1,44 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_MAGIC 0x5453534fU // "OSST"
+#define TRACE_VERSION 2
+
+enum Trace_Types {TRACE_ADMIT, TRACE_REQUEST, TRACE_GRANT, TRACE_DENY, TRACE_PARK, TRACE_GRANT_PARKED,
+    TRACE_RELEASE, TRACE_TERMINATE, TRACE_ROLLBACK};
+
+// File header, followed by num_res int16 resource totals then num_res
+// int16 flags marking the shared resources
+struct trace_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    int32_t num_procs;
+    int32_t num_res;
+    uint64_t seed;
+};
+
+// Every event is this 16 byte record. ADMIT (the maximum claim) and REQUEST
+// are followed by num_res int16 values; every other type carries none.
+struct trace_record {
+    uint64_t time;
+    uint8_t type;
+    uint8_t reserved;
+    int16_t sim_pid;
+    uint16_t num_res;
+    uint16_t reserved2;
+};
+
+bool trace_open(const char* path, int num_procs, int num_res, uint64_t seed, const int16_t* totals, const int16_t* shared);
+bool trace_is_open();
+void trace_event(uint64_t time, int type, int sim_pid, const int* vector);
+void trace_close();
+
+FILE* trace_read_open(const char* path, struct trace_header* header, int16_t* totals, int16_t* shared, int max_res);
+bool trace_read(FILE* file, struct trace_record* record, int16_t* vector, int max_res);
+
+#endif
@@ -3,37 +3,227 @@
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
 
 #include "shared.h"
 #include "config.h"
+#include "rng.h"
 
 extern struct oss_shm* shared_mem;
 static struct message msg;
 static struct time_clock endtime;
 static char* exe_name;
 static int sim_pid;
+static bool pool_worker = false;
+static bool echo_mode = false;
+static struct rng rng;
+static double* zipf_cdf = NULL;
+static bool bursting = false;
 
 void help() {
     printf("Operating System Simulator Child usage\n");
     printf("Runs as a child of the OSS. Not to be run alone.\n");
+    printf("[-p pid]\tThe simulated pid (process table slot) of the process.\n");
+    printf("[-w]\tRun as a pool worker that takes a new identity from each reset message.\n");
+    printf("[-e]\tRun as an IPC benchmark echo child (see oss -B).\n");
+    printf("[-D fd]\tEventfd to ring after messaging oss while it waits on us.\n");
+}
+
+// Take on a fresh simulated identity
+void reset_child() {
+    struct process_ctrl_block* pcb = shm_pcb(shared_mem, sim_pid);
+    // Seeded runs give every process its own stream keyed by its spawn order
+    if (shared_mem->seeded) rng_seed(&rng, shared_mem->seed ^ (pcb->spawn_seq * 2654435761ULL));
+    bursting = false;
+
+    // Calculate a random endtime about 1-5 seconds after oss spawned us
+    clock_set(&endtime, pcb->spawn_ns);
+    add_time(&endtime, rng_below(&rng, 5) + 1, rng_below(&rng, 100000000) + 1000);
+}
+
+// Cumulative Zipf weights over the resources, so resource 0 is the most asked for
+void build_zipf(int num_res) {
+    zipf_cdf = malloc(num_res * sizeof(double));
+    double total = 0.0;
+    for (int i = 0; i < num_res; i++) {
+        total += 1.0 / pow(i + 1, ZIPF_EXPONENT);
+        zipf_cdf[i] = total;
+    }
+    for (int i = 0; i < num_res; i++) {
+        zipf_cdf[i] /= total;
+    }
+}
+
+// Pick a resource by Zipf popularity
+int zipf_pick(int num_res) {
+    double u = rng_double(&rng);
+    int low = 0, high = num_res - 1;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (zipf_cdf[mid] < u) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+// Fill need with what we may still ask for, from one snapshot of our rows rather than
+// re-reading them per resource. Once we have released we may ask for the whole claim again.
+void read_need(int16_t* need, int num_res, bool released) {
+    int16_t max_res[num_res], allow_res[num_res];
+    memcpy(max_res, pcb_max_res(shared_mem, sim_pid), sizeof(max_res));
+    memcpy(allow_res, pcb_allow_res(shared_mem, sim_pid), sizeof(allow_res));
+    for (int i = 0; i < num_res; i++) {
+        int left = max_res[i] - (released ? 0 : allow_res[i]);
+        need[i] = left > 0 ? left : 0;
+    }
+}
+
+// Fill request with a vector within need, shaped by request_dist
+void build_request(int16_t* request, const int16_t* need, int num_res) {
+    switch (shared_mem->config.request_dist) {
+        case DIST_ZIPF:
+            // A few popular resources, each asked for in full or in part
+            memset(request, 0, num_res * sizeof(int16_t));
+            for (int d = 0; d < ZIPF_DRAWS; d++) {
+                int res = zipf_pick(num_res);
+                if (need[res] > 0) request[res] = rng_below(&rng, need[res]) + 1;
+            }
+            break;
+        case DIST_BURSTY:
+            // Quiet stretches of single units broken up by bursts of large requests
+            if (rng_below(&rng, 100) < BURST_SWITCH_PCT) bursting = !bursting;
+            memset(request, 0, num_res * sizeof(int16_t));
+            if (bursting) {
+                uint64_t bits = 0;
+                for (int i = 0; i < num_res; i++) {
+                    if (i % 64 == 0) bits = rng_next(&rng);
+                    if (bits & (1ULL << (i % 64))) request[i] = need[i];
+                }
+            }
+            else {
+                int res = rng_below(&rng, num_res);
+                if (need[res] > 0) request[res] = 1;
+            }
+            break;
+        default: {
+            // Anything from nothing up to the whole need, per resource
+            int16_t bound[num_res];
+            for (int i = 0; i < num_res; i++) {
+                bound[i] = need[i] + 1;
+            }
+            rng_fill_below(&rng, request, bound, num_res);
+            break;
+        }
+    }
+}
+
+// Quantum mode: draw up to config.batch operations the way single turns draw them and
+// send them in one message, then read back how they went. Returns whether we may now
+// hold resources. Each request is drawn as if the ones before it in the batch were all
+// granted, so even then the batch stays within our claim.
+bool run_batch(bool has_resources) {
+    int num_res = shared_mem->config.resources;
+    int max_ops = shared_mem->config.batch;
+    int16_t opcodes[max_ops];
+    int16_t vectors[max_ops * num_res];
+    int num_ops = 0, num_requests = 0;
+    bool maybe_holding = has_resources;
+    int16_t need[num_res];
+    read_need(need, num_res, false);
+
+    for (int i = 0; i < max_ops; i++) {
+        // Same 50% chance to release as a single turn, if we might hold anything
+        if ((rng_below(&rng, 10) > 5) && maybe_holding) {
+            opcodes[num_ops++] = MSG_RELEASE;
+            read_need(need, num_res, true);
+            maybe_holding = false;
+        }
+        else {
+            int16_t* request = &vectors[num_requests++ * num_res];
+            opcodes[num_ops++] = MSG_REQUEST;
+            build_request(request, need, num_res);
+            for (int j = 0; j < num_res; j++) {
+                need[j] -= request[j];
+            }
+            maybe_holding = true;
+        }
+    }
+
+    msg_init(&msg, getpid(), MSG_BATCH, sim_pid);
+    msg.num_ops = num_ops;
+    memcpy(msg.resources, opcodes, num_ops * sizeof(int16_t));
+    memcpy(msg.resources + num_ops, vectors, num_requests * num_res * sizeof(int16_t));
+    msg.num_res = num_ops + num_requests * num_res;
+    send_msg(&msg, OSS_MSG, false);
+
+    // Results come back in order for the operations oss got to
+    recieve_msg(&msg, PROC_MSG, true);
+    if (msg.opcode != MSG_RESULTS) return has_resources;
+    bool parked = false;
+    for (int i = 0; i < msg.num_ops; i++) {
+        if (msg.resources[i] == MSG_ACQUIRED) has_resources = true;
+        else if (msg.resources[i] == MSG_RELEASE) has_resources = false;
+        else if (msg.resources[i] == MSG_PARKED) parked = true;
+    }
+    // A parked request is answered once it is granted or rolled back
+    if (parked) {
+        recieve_msg(&msg, PROC_MSG, true);
+        if (msg.opcode == MSG_ACQUIRED) has_resources = true;
+    }
+    return has_resources;
+}
+
+// Pool workers wait here between simulated processes. Returns false if told to exit.
+bool wait_for_reset() {
+    while (true) {
+        msg_init(&msg, getpid(), MSG_RESET, sim_pid);
+        recieve_msg(&msg, PROC_MSG, true);
+        if (msg.opcode == MSG_RESET) return true;
+        if (msg.opcode == MSG_EXIT) return false;
+    }
+}
+
+// Benchmark loop: answer every run message with a request the size of a real one, or a
+// full batch of them in quantum mode, and read the answer back
+void echo_loop() {
+    int num_res = shared_mem->config.resources;
+    int batch = shared_mem->config.batch;
+    while (true) {
+        msg_init(&msg, getpid(), MSG_RUN, sim_pid);
+        recieve_msg(&msg, PROC_MSG, true);
+        if (msg.opcode == MSG_EXIT) return;
+
+        if (batch > 1) {
+            msg_init(&msg, getpid(), MSG_BATCH, sim_pid);
+            msg.num_ops = batch;
+            msg.num_res = batch * (num_res + 1);
+            memset(msg.resources, 0, msg.num_res * sizeof(int16_t));
+            for (int i = 0; i < batch; i++) {
+                msg.resources[i] = MSG_REQUEST;
+            }
+        }
+        else {
+            msg_init(&msg, getpid(), MSG_REQUEST, sim_pid);
+            msg.num_res = num_res;
+            memset(msg.resources, 0, msg.num_res * sizeof(int16_t));
+        }
+        send_msg(&msg, OSS_MSG, false);
+        recieve_msg(&msg, PROC_MSG, true);
+    }
 }
 
 void init_child() {
     // Init rand gen, shared mem, and msg queues
-    srand((int)time(NULL) + getpid());
-    init_oss(false);
-
-    // Calculate a random endtime about 1-5 seconds after current sys time
-    endtime.nanoseconds = (rand() % 100000000) + 1000;
-    endtime.seconds = (rand() % 5) + 1;
-    add_time(&endtime, shared_mem->sys_clock.seconds, shared_mem->sys_clock.nanoseconds);
+    rng_seed(&rng, ((uint64_t)time(NULL) << 32) ^ getpid());
+    init_oss(false, NULL);
+    if (shared_mem->config.request_dist == DIST_ZIPF) build_zipf(shared_mem->config.resources);
 }
 
 int main(int argc, char** argv) {
     int option;
     exe_name = argv[0];
 
-    while ((option = getopt(argc, argv, "hp:")) != -1) {
+    while ((option = getopt(argc, argv, "D:ehp:w")) != -1) {
         switch (option)
         {
         case 'h':
@@ -42,57 +232,81 @@ int main(int argc, char** argv) {
         case 'p':
             sim_pid = atoi(optarg);
             break;
+        case 'w':
+            pool_worker = true;
+            break;
+        case 'e':
+            echo_mode = true;
+            break;
+        case 'D':
+            set_doorbell(atoi(optarg));
+            break;
         case '?':
             // Getopt handles error messages
             exit(EXIT_FAILURE);
         }
     }
     init_child();
+    if (echo_mode) {
+        echo_loop();
+        exit(EXIT_SUCCESS);
+    }
+
+    // Pool workers are started ahead of time and get their first identity from a reset
+    if (pool_worker && !wait_for_reset()) exit(EXIT_SUCCESS);
+    reset_child();
 
     bool has_resources = false;
     bool can_terminate = false;
 
     while (true) {
-        strncpy(msg.msg_text, "", MSG_BUFFER_LEN);
-        msg.msg_type = getpid();
+        msg_init(&msg, getpid(), MSG_RUN, sim_pid);
         recieve_msg(&msg, PROC_MSG, true);
 
         // See if enough time has passed to terminate process
-        if (shared_mem->sys_clock.seconds > endtime.seconds && shared_mem->sys_clock.nanoseconds > endtime.nanoseconds) {
+        unsigned long now_secs, now_nsecs, end_secs, end_nsecs;
+        clock_read(&shared_mem->sys_clock, &now_secs, &now_nsecs);
+        clock_read(&endtime, &end_secs, &end_nsecs);
+        if (now_secs > end_secs && now_nsecs > end_nsecs) {
             can_terminate = true;
         }
 
         // If this process can terminate terminiate it
         if (can_terminate) {
-            strncpy(msg.msg_text, "terminate", MSG_BUFFER_LEN);
-            msg.msg_type = getpid();
+            msg_init(&msg, getpid(), MSG_TERMINATE, sim_pid);
             send_msg(&msg, OSS_MSG, false);
-            exit(sim_pid);
+            if (!pool_worker) exit(sim_pid);
+
+            // Go back to the pool until OSS hands us a new identity
+            if (!wait_for_reset()) exit(EXIT_SUCCESS);
+            reset_child();
+            has_resources = false;
+            can_terminate = false;
+        }
+        // Quantum mode sends several operations per turn
+        else if (shared_mem->config.batch > 1) {
+            has_resources = run_batch(has_resources);
         }
         // 50% chance to release resource if it has one
-        else if ((rand() % 10 > 5) && has_resources) {
-            strncpy(msg.msg_text, "release", MSG_BUFFER_LEN);
-            msg.msg_type = getpid();
+        else if ((rng_below(&rng, 10) > 5) && has_resources) {
+            msg_init(&msg, getpid(), MSG_RELEASE, sim_pid);
             send_msg(&msg, OSS_MSG, false);
             has_resources = false;
         }
         // Try to acquire a resource
         else {
-            snprintf(msg.msg_text, MSG_BUFFER_LEN, "request");
+            msg_init(&msg, getpid(), MSG_REQUEST, sim_pid);
             // Get a random resource
-            for (int i = 0; i < MAX_RES_INSTANCES; i++) {
-                char resource_requested[MSG_BUFFER_LEN];
-                int max = shared_mem->process_table[sim_pid].max_res[i] - shared_mem->process_table[sim_pid].allow_res[i] + 1;
-                snprintf(resource_requested, MSG_BUFFER_LEN, " %d", rand() % max);
-                strncat(msg.msg_text, resource_requested, MSG_BUFFER_LEN - strlen(msg.msg_text));
-            }
+            msg.num_res = shared_mem->config.resources;
+            int16_t need[msg.num_res];
+            read_need(need, msg.num_res, false);
+            build_request(msg.resources, need, msg.num_res);
             // Send request for resource
-            msg.msg_type = getpid();
             send_msg(&msg, OSS_MSG, false);
 
             // Wait for response back to see if we have acquired resource or not
             recieve_msg(&msg, PROC_MSG, true);
-            if (strncmp(msg.msg_text, "acquired", MSG_BUFFER_LEN) == 0) {
+            if (msg.opcode == MSG_ACQUIRED) {
                 has_resources = true;
             }
         }
@@ -0,0 +1,152 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "waitlist.h"
+#include "queue.h"
+
+static struct Queue* lists = NULL;
+static int* requests = NULL;
+static bool* parked = NULL;
+static bool* settled = NULL;
+static unsigned long* parked_at = NULL;
+static unsigned long frees = 0;
+static bool* freed = NULL;
+static bool* seen = NULL;
+static int num_procs = 0;
+static int num_resources = 0;
+static size_t num_parked = 0;
+
+// Public function to allocate one list per resource and a pending request row per process
+bool waitlist_init(int max_procs, int num_res) {
+	num_procs = max_procs;
+	num_resources = num_res;
+	num_parked = 0;
+	lists = malloc(num_res * sizeof(struct Queue));
+	requests = calloc((size_t)max_procs * num_res, sizeof(int));
+	parked = calloc(max_procs, sizeof(bool));
+	settled = calloc(max_procs, sizeof(bool));
+	parked_at = calloc(max_procs, sizeof(unsigned long));
+	seen = calloc(max_procs, sizeof(bool));
+	freed = calloc(num_res, sizeof(bool));
+	if (lists == NULL || requests == NULL || parked == NULL || settled == NULL || parked_at == NULL || seen == NULL || freed == NULL) {
+		waitlist_free();
+		return false;
+	}
+	for (int i = 0; i < num_res; i++) {
+		queue_init(&lists[i], max_procs);
+	}
+	return true;
+}
+
+void waitlist_free() {
+	if (lists != NULL) {
+		for (int i = 0; i < num_resources; i++) {
+			queue_free(&lists[i]);
+		}
+	}
+	free(lists);
+	free(requests);
+	free(parked);
+	free(settled);
+	free(parked_at);
+	free(seen);
+	free(freed);
+	lists = NULL;
+	requests = NULL;
+	parked = NULL;
+	settled = NULL;
+	parked_at = NULL;
+	seen = NULL;
+	freed = NULL;
+}
+
+// Public function to park a process's request on the list of every resource it asks for
+void waitlist_park(int sim_pid, const int* request) {
+	int* row = &requests[(size_t)sim_pid * num_resources];
+	memcpy(row, request, num_resources * sizeof(int));
+	for (int i = 0; i < num_resources; i++) {
+		if (row[i] > 0) queue_insert(&lists[i], sim_pid);
+	}
+	if (!parked[sim_pid]) num_parked++;
+	parked[sim_pid] = true;
+	settled[sim_pid] = false;
+	parked_at[sim_pid] = frees;
+}
+
+// Public function to take a process off every list once its request is granted
+void waitlist_unpark(int sim_pid) {
+	if (!parked[sim_pid]) return;
+	for (int i = 0; i < num_resources; i++) {
+		queue_remove(&lists[i], sim_pid);
+	}
+	parked[sim_pid] = false;
+	settled[sim_pid] = false;
+	num_parked--;
+}
+
+// Public function to make a parked request grantable once its turn is over. If anything was
+// freed after it parked, its resources are marked so the next collect re-checks it.
+void waitlist_settle(int sim_pid) {
+	if (!parked[sim_pid]) return;
+	settled[sim_pid] = true;
+	if (parked_at[sim_pid] == frees) return;
+	int* row = &requests[(size_t)sim_pid * num_resources];
+	for (int i = 0; i < num_resources; i++) {
+		if (row[i] > 0) freed[i] = true;
+	}
+}
+
+bool waitlist_is_parked(int sim_pid) {
+	return parked[sim_pid];
+}
+
+// Public function to see if sim_pid is parked and its turn has been settled
+bool waitlist_is_waiting(int sim_pid) {
+	return parked[sim_pid] && settled[sim_pid];
+}
+
+// Public function to get every process's pending request row, num_res entries per process
+const int* waitlist_requests() {
+	return requests;
+}
+
+int* waitlist_request(int sim_pid) {
+	return &requests[(size_t)sim_pid * num_resources];
+}
+
+// Public function to note that instances of resource were released
+void waitlist_freed(int resource) {
+	freed[resource] = true;
+	frees++;
+}
+
+// Public function to rescan every list on the next collect
+void waitlist_freed_all() {
+	for (int i = 0; i < num_resources; i++) {
+		freed[i] = true;
+	}
+}
+
+// Public function to gather the parked processes waiting on a freed resource, oldest first
+// per list and each at most once, then clear the freed marks. Returns the count written.
+int waitlist_collect(int* sim_pids) {
+	int count = 0;
+	for (int i = 0; i < num_resources; i++) {
+		if (!freed[i]) continue;
+		freed[i] = false;
+		for (int sim_pid = lists[i].front_ind; sim_pid >= 0; sim_pid = lists[i].next[sim_pid]) {
+			if (seen[sim_pid] || !settled[sim_pid]) continue;
+			seen[sim_pid] = true;
+			sim_pids[count++] = sim_pid;
+		}
+	}
+	for (int i = 0; i < count; i++) {
+		seen[sim_pids[i]] = false;
+	}
+	return count;
+}
+
+size_t waitlist_parked() {
+	return num_parked;
+}
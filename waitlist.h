@@ -0,0 +1,26 @@
+#ifndef __WAITLIST_H
+#define __WAITLIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Per-resource FIFO lists of parked requests. A parked process is listed on
+// every resource it asked for and stays off the ready queue until its request
+// is granted. Releases mark resources as freed so only their lists are rescanned.
+// A request is parked by whichever thread served the turn but is only considered
+// for granting once the main thread has settled that turn.
+bool waitlist_init(int max_procs, int num_res);
+void waitlist_free();
+void waitlist_park(int sim_pid, const int* request);
+void waitlist_unpark(int sim_pid);
+void waitlist_settle(int sim_pid);
+bool waitlist_is_parked(int sim_pid);
+bool waitlist_is_waiting(int sim_pid);
+int* waitlist_request(int sim_pid);
+const int* waitlist_requests();
+void waitlist_freed(int resource);
+void waitlist_freed_all();
+int waitlist_collect(int* sim_pids);
+size_t waitlist_parked();
+
+#endif
@@ -0,0 +1,187 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "watch.h"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+static int epoll_fd = -1;
+static int turn_fd = -1;
+static int timer_fd = -1;
+static int* doorbells = NULL;
+static int* pidfds = NULL;
+static int num_slots = 0;
+static volatile sig_atomic_t* stop_flag = NULL;
+
+// Private function to pack an event kind and slot into epoll's user data
+static uint64_t watch_tag(int kind, int sim_pid) {
+	return ((uint64_t)kind << 32) | (uint32_t)sim_pid;
+}
+
+// Private function to add fd to the epoll set
+static bool watch_add(int fd, uint32_t flags, int kind, int sim_pid) {
+	struct epoll_event event;
+	event.events = flags;
+	event.data.u64 = watch_tag(kind, sim_pid);
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+		perror("Could not watch descriptor");
+		return false;
+	}
+	return true;
+}
+
+// Private function to clear an eventfd or timerfd count
+static void watch_drain(int fd) {
+	uint64_t count;
+	if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) perror("Could not read event count");
+}
+
+// Public function to create the epoll set for max_procs slots, with a timer firing every timer_ns
+bool watch_init(int max_procs, uint64_t timer_ns) {
+	// Two descriptors per slot can pass the default soft limit, so raise it as far as allowed
+	struct rlimit limit;
+	rlim_t wanted = 2 * (rlim_t)max_procs + 64;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < wanted) {
+		limit.rlim_cur = limit.rlim_max < wanted ? limit.rlim_max : wanted;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	num_slots = max_procs;
+	doorbells = malloc(max_procs * sizeof(int));
+	pidfds = malloc(max_procs * sizeof(int));
+	for (int i = 0; i < max_procs; i++) {
+		doorbells[i] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		pidfds[i] = -1;
+		if (doorbells[i] < 0) {
+			perror("Could not create doorbell");
+			return false;
+		}
+	}
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	turn_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (epoll_fd < 0 || turn_fd < 0 || timer_fd < 0) {
+		perror("Could not create event loop");
+		return false;
+	}
+	struct itimerspec period;
+	period.it_interval.tv_sec = timer_ns / 1000000000ULL;
+	period.it_interval.tv_nsec = timer_ns % 1000000000ULL;
+	period.it_value = period.it_interval;
+	if (timerfd_settime(timer_fd, 0, &period, NULL) < 0) perror("Could not start timer");
+	return watch_add(turn_fd, EPOLLIN, WATCH_TURN, 0) && watch_add(timer_fd, EPOLLIN, WATCH_TIMER, 0);
+}
+
+// Public function to close every descriptor of the event loop
+void watch_close() {
+	for (int i = 0; i < num_slots; i++) {
+		if (pidfds[i] >= 0) close(pidfds[i]);
+		if (doorbells[i] >= 0) close(doorbells[i]);
+	}
+	if (epoll_fd >= 0) close(epoll_fd);
+	if (turn_fd >= 0) close(turn_fd);
+	if (timer_fd >= 0) close(timer_fd);
+	free(doorbells);
+	free(pidfds);
+	doorbells = NULL;
+	pidfds = NULL;
+	num_slots = 0;
+	epoll_fd = turn_fd = timer_fd = -1;
+}
+
+// Public function to make watch_reply give up once flag is set, e.g. by a signal handler
+void watch_stop_on(volatile sig_atomic_t* flag) {
+	stop_flag = flag;
+}
+
+// Public function to get the doorbell a child in sim_pid's slot rings, to hand it over exec
+int watch_doorbell(int sim_pid) {
+	return doorbells[sim_pid];
+}
+
+// Public function to get the eventfd finished dispatcher turns are counted on
+int watch_turn_fd() {
+	return turn_fd;
+}
+
+// Public function to start watching pid, the child in sim_pid's slot, for its exit.
+// The exit is reported once by watch_wait and stays visible to watch_reply.
+void watch_child(int sim_pid, pid_t pid) {
+	if (pidfds[sim_pid] >= 0) watch_forget(sim_pid);
+	pidfds[sim_pid] = syscall(SYS_pidfd_open, pid, 0);
+	if (pidfds[sim_pid] < 0) {
+		perror("Could not open pidfd");
+		return;
+	}
+	watch_add(pidfds[sim_pid], EPOLLIN | EPOLLONESHOT, WATCH_EXIT, sim_pid);
+}
+
+// Public function to stop watching the child in sim_pid's slot
+void watch_forget(int sim_pid) {
+	if (pidfds[sim_pid] < 0) return;
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pidfds[sim_pid], NULL);
+	close(pidfds[sim_pid]);
+	pidfds[sim_pid] = -1;
+}
+
+// Public function to wait for the reply from sim_pid's child into msg, whose type must
+// already be set. Returns false if the child exited without replying, or if the stop flag
+// was set while it had not. Only one thread may wait on a slot at a time.
+bool watch_reply(struct oss_shm* shm, int sim_pid, struct message* msg) {
+	struct process_ctrl_block* pcb = shm_pcb(shm, sim_pid);
+	struct pollfd fds[2] = {
+		{.fd = doorbells[sim_pid], .events = POLLIN},
+		{.fd = pidfds[sim_pid], .events = POLLIN},
+	};
+	bool replied = false;
+
+	// Say we are waiting, then check. The child sends, then checks, so one of us sees the other.
+	__atomic_store_n(&pcb->oss_waiting, 1, __ATOMIC_SEQ_CST);
+	while (!(replied = recieve_msg(msg, OSS_MSG, false))) {
+		// Wait in slices so a stop is seen even if its signal went to another thread
+		if (stop_flag != NULL && *stop_flag) break;
+		if (poll(fds, pidfds[sim_pid] >= 0 ? 2 : 1, STOP_CHECK_MS) < 0) {
+			if (errno == EINTR) continue;
+			perror("Could not wait on child");
+			break;
+		}
+		if (fds[0].revents & POLLIN) watch_drain(doorbells[sim_pid]);
+		// It may have replied just before it exited
+		if (fds[1].revents & POLLIN) {
+			replied = recieve_msg(msg, OSS_MSG, false);
+			break;
+		}
+	}
+	__atomic_store_n(&pcb->oss_waiting, 0, __ATOMIC_SEQ_CST);
+	return replied;
+}
+
+// Public function to wait up to timeout_ms (-1 for ever) for the event loop. Fills events
+// with up to max_events of what is ready and returns how many, 0 on timeout or a signal.
+int watch_wait(struct watch_event* events, int max_events, int timeout_ms) {
+	struct epoll_event ready[max_events];
+	int count = epoll_wait(epoll_fd, ready, max_events, timeout_ms);
+	if (count < 0) {
+		if (errno != EINTR) perror("Could not wait on event loop");
+		return 0;
+	}
+	for (int i = 0; i < count; i++) {
+		events[i].kind = ready[i].data.u64 >> 32;
+		events[i].sim_pid = (int)(uint32_t)ready[i].data.u64;
+		if (events[i].kind == WATCH_TURN) watch_drain(turn_fd);
+		if (events[i].kind == WATCH_TIMER) watch_drain(timer_fd);
+	}
+	return count;
+}
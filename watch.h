@@ -0,0 +1,34 @@
+#ifndef __WATCH_H
+#define __WATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/types.h>
+
+#include "shared.h"
+
+// What became ready in the OSS event loop
+enum Watch_Kinds {WATCH_EXIT, WATCH_TURN, WATCH_TIMER};
+
+struct watch_event {
+    int kind;
+    int sim_pid;
+};
+
+// One epoll set for the OSS main loop. It holds a pidfd per child, reported
+// once when the child exits, an eventfd the dispatcher threads count finished
+// turns on, and a timerfd for periodic wall clock work. Each process table slot
+// also has a doorbell eventfd its child rings after replying while the OSS is
+// waiting on it, so a reply wait can also see the child exit.
+bool watch_init(int max_procs, uint64_t timer_ns);
+void watch_close();
+void watch_stop_on(volatile sig_atomic_t* flag);
+int watch_doorbell(int sim_pid);
+int watch_turn_fd();
+void watch_child(int sim_pid, pid_t pid);
+void watch_forget(int sim_pid);
+bool watch_reply(struct oss_shm* shm, int sim_pid, struct message* msg);
+int watch_wait(struct watch_event* events, int max_events, int timeout_ms);
+
+#endif